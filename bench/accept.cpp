@@ -0,0 +1,310 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "bench.h"
+#include "ioservicepool.h"
+
+#include <boost/enable_shared_from_this.hpp>
+
+#include <atomic>
+#include <vector>
+
+// ============================================================ //
+
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+
+typedef boost::shared_ptr<boost::asio::ip::tcp::acceptor> ACCEPTOR;
+
+typedef boost::shared_ptr<boost::asio::ip::tcp::socket> SOCKET;
+
+// ============================================================ //
+// Listener
+// ============================================================ //
+
+/*
+ * The accept loop of Server::listen and Server::handleSession.
+ * Every acceptor sits on its own shard and keeps pendingAccepts
+ * operations outstanding, accepted sockets are created on the
+ * shard picked by the pool and closed right away.
+ */
+
+class Listener : public boost::enable_shared_from_this<Listener>
+{
+public:
+
+    typedef boost::shared_ptr<Listener> Pointer;
+
+    static Pointer create(IO_SERVICE_POOL pool)
+    {
+        return Pointer(new Listener(pool));
+    }
+
+    bool listen(uint32_t numAcceptors, uint32_t pendingAccepts)
+    {
+        using namespace boost::asio::ip;
+
+        try {
+
+            m_endpoint = tcp::endpoint(address_v4::loopback(), 0);
+
+            for (uint32_t i=0; i<numAcceptors; ++i) {
+
+                ACCEPTOR acceptor = boost::make_shared<tcp::acceptor>(m_pool->shard(i)->io_service());
+
+                acceptor->open(tcp::v4());
+
+                acceptor->set_option(tcp::acceptor::reuse_address(true));
+
+                if (numAcceptors > 1) {
+
+                    acceptor->set_option(reuse_port(true));
+                }
+
+                acceptor->bind(m_endpoint);
+
+                acceptor->listen();
+
+                // the others bind the port the first one got
+
+                m_endpoint = acceptor->local_endpoint();
+
+                m_acceptors.push_back(acceptor);
+            }
+        }
+        catch (std::exception &e) {
+
+            fprintf(stderr, "listen: %s\n", e.what());
+
+            return false;
+        }
+
+        for (ACCEPTOR &acceptor : m_acceptors) {
+
+            for (uint32_t j=0; j<pendingAccepts; ++j) {
+
+                accept(acceptor);
+            }
+        }
+
+        return true;
+    }
+
+    // every acceptor is closed on its own shard, the
+    // aborted accepts then let go of the listener
+
+    void close()
+    {
+        for (uint32_t i=0; i<m_acceptors.size(); ++i) {
+
+            ACCEPTOR acceptor = m_acceptors[i];
+
+            m_pool->shard(i)->io_service().post([acceptor] () {
+
+                boost::system::error_code ec;
+
+                acceptor->close(ec);
+            });
+        }
+    }
+
+    boost::asio::ip::tcp::endpoint endpoint()
+    {
+        return m_endpoint;
+    }
+
+    uint64_t accepted()
+    {
+        return m_accepted.load(std::memory_order_relaxed);
+    }
+
+protected:
+
+    Listener(IO_SERVICE_POOL pool)
+        : m_pool(pool),
+          m_accepted(0)
+    {
+
+    }
+
+    void accept(ACCEPTOR acceptor)
+    {
+        SOCKET socket = boost::make_shared<boost::asio::ip::tcp::socket>(m_pool->select()->io_service());
+
+        acceptor->async_accept(
+                    *socket,
+                    boost::bind(&Listener::handleAccept,
+                                shared_from_this(),
+                                boost::asio::placeholders::error,
+                                acceptor,
+                                socket));
+    }
+
+    void handleAccept(const boost::system::error_code &err, ACCEPTOR acceptor, SOCKET socket)
+    {
+        if (err == boost::asio::error::operation_aborted || !acceptor->is_open()) {
+
+            return;
+        }
+
+        if (!err) {
+
+            m_accepted.fetch_add(1, std::memory_order_relaxed);
+
+            boost::system::error_code ec;
+
+            socket->close(ec);
+        }
+
+        accept(acceptor);
+    }
+
+protected:
+
+    IO_SERVICE_POOL m_pool;
+
+    std::vector<ACCEPTOR> m_acceptors;
+
+    boost::asio::ip::tcp::endpoint m_endpoint;
+
+    std::atomic<uint64_t> m_accepted;
+};
+
+// ============================================================ //
+
+// connects and resets in a loop, the linger of 0 avoids
+// running out of ports to sockets in TIME_WAIT
+
+void client(boost::asio::ip::tcp::endpoint endpoint, std::atomic<bool> &stop)
+{
+    boost::asio::io_service io_service;
+
+    while (!stop.load(std::memory_order_relaxed)) {
+
+        boost::asio::ip::tcp::socket socket(io_service);
+
+        boost::system::error_code ec;
+
+        socket.connect(endpoint, ec);
+
+        if (!ec) {
+
+            socket.set_option(boost::asio::socket_base::linger(true, 0), ec);
+        }
+
+        socket.close(ec);
+    }
+}
+
+// ============================================================ //
+
+// accepts per second over the given number of seconds
+
+double run(uint32_t numWorkers, uint32_t numAcceptors, uint32_t pendingAccepts, uint32_t numClients, uint32_t seconds)
+{
+    IO_SERVICE_POOL pool = IoServicePool::create(numWorkers, 1);
+
+    Listener::Pointer listener = Listener::create(pool);
+
+    if (!listener->listen(numAcceptors, pendingAccepts)) {
+
+        return 0;
+    }
+
+    pool->run();
+
+    std::atomic<bool> stop(false);
+
+    boost::thread_group clients;
+
+    for (uint32_t i=0; i<numClients; ++i) {
+
+        clients.create_thread(boost::bind(&client, listener->endpoint(), boost::ref(stop)));
+    }
+
+    // let the clients get going before measuring
+
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(200));
+
+    uint64_t begin = Bench::now();
+
+    uint64_t accepted = listener->accepted();
+
+    boost::this_thread::sleep_for(boost::chrono::seconds(seconds));
+
+    accepted = listener->accepted() - accepted;
+
+    uint64_t end = Bench::now();
+
+    stop = true;
+
+    clients.join_all();
+
+    listener->close();
+
+    pool->release();
+
+    pool->join();
+
+    return accepted / Bench::seconds(begin, end);
+}
+
+// ============================================================ //
+
+// usage: bench_accept [workers] [clients] [pending accepts] [seconds]
+
+int main(int argc, char **argv)
+{
+    uint32_t numWorkers = Bench::argument(argc, argv, 1, std::max(1u, boost::thread::hardware_concurrency()));
+
+    uint32_t numClients = Bench::argument(argc, argv, 2, 4);
+
+    uint32_t pendingAccepts = Bench::argument(argc, argv, 3, 16);
+
+    uint32_t seconds = Bench::argument(argc, argv, 4, 2);
+
+    printf("workers %u, clients %u, %u second(s) per run\n", numWorkers, numClients, seconds);
+
+    uint32_t runs[][2] = {
+        {1, 1},
+        {1, pendingAccepts},
+        {numWorkers, 1},
+        {numWorkers, pendingAccepts}
+    };
+
+    for (auto &r : runs) {
+
+        double rate = run(numWorkers, r[0], r[1], numClients, seconds);
+
+        printf("%3u acceptor(s), %3u pending   %12.0f accepts/s\n", r[0], r[1], rate);
+    }
+
+    return 0;
+}
+
+// ============================================================ //
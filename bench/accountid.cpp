@@ -0,0 +1,157 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "bench.h"
+#include "db.h"
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// ============================================================ //
+
+/*
+ * A signup burst against the mongod on 127.0.0.1, every thread
+ * allocating account ids back to back. The old allocation asks
+ * zway.accounts for its highest id on every signup, the block
+ * allocator is DB::newAccountId. Reserving blocks advances the
+ * zway.counters document, the ids taken here are skipped later
+ * but nothing else is written.
+ */
+
+// ============================================================ //
+
+uint32_t sortAndIncrement()
+{
+    DB::Connection::LOCK lock = DB::acquire();
+
+    try {
+
+        mongo::BSONObj fieldsToReturn = BSON("id" << 1);
+
+        std::unique_ptr<mongo::DBClientCursor> cursor = lock->db()->query("zway.accounts", mongo::Query().sort("id", -1), 1, 0, &fieldsToReturn);
+
+        if (cursor->more()) {
+
+            return cursor->next().getIntField("id") + 1;
+        }
+    }
+    catch (std::exception &) {
+
+        return 0;
+    }
+
+    return 1;
+}
+
+// ============================================================ //
+
+void worker(uint32_t (*allocate)(), uint32_t signups, std::vector<uint32_t> &ids)
+{
+    for (uint32_t i=0; i<signups; ++i) {
+
+        ids[i] = allocate();
+    }
+}
+
+// ids per second, ids receives all of them
+
+double run(uint32_t (*allocate)(), uint32_t numThreads, uint32_t signups, std::vector<uint32_t> &ids)
+{
+    std::vector<std::vector<uint32_t>> res(numThreads, std::vector<uint32_t>(signups));
+
+    boost::thread_group threads;
+
+    uint64_t begin = Bench::now();
+
+    for (uint32_t i=0; i<numThreads; ++i) {
+
+        threads.create_thread(boost::bind(&worker, allocate, signups, boost::ref(res[i])));
+    }
+
+    threads.join_all();
+
+    uint64_t end = Bench::now();
+
+    ids.clear();
+
+    for (auto &r : res) {
+
+        ids.insert(ids.end(), r.begin(), r.end());
+    }
+
+    return (double)numThreads * signups / Bench::seconds(begin, end);
+}
+
+// ============================================================ //
+
+// usage: bench_accountid [threads] [signups per thread]
+
+int main(int argc, char **argv)
+{
+    uint32_t numThreads = Bench::argument(argc, argv, 1, 16);
+
+    uint32_t signups = Bench::argument(argc, argv, 2, 1000);
+
+    DB::PoolOptions poolOptions;
+
+    poolOptions.maxConnections = std::max(poolOptions.maxConnections, numThreads);
+
+    if (!DB::startup("127.0.0.1", poolOptions)) {
+
+        fprintf(stderr, "Failed to connect to mongod on 127.0.0.1\n");
+
+        return 1;
+    }
+
+    printf("threads %u, signups per thread %u, block size %u\n", numThreads, signups, ACCOUNT_ID_BLOCK);
+
+    std::vector<uint32_t> ids;
+
+    printf("sort and increment   %10.0f ids/s\n", run(&sortAndIncrement, numThreads, signups, ids));
+
+    double rate = run(&DB::newAccountId, numThreads, signups, ids);
+
+    // every id handed out by the allocator has to be unique
+
+    std::sort(ids.begin(), ids.end());
+
+    size_t failed = std::count(ids.begin(), ids.end(), 0);
+
+    size_t duplicates = ids.end() - std::unique(ids.begin(), ids.end());
+
+    printf("block allocator      %10.0f ids/s, %zu failed, %zu duplicates\n", rate, failed, duplicates);
+
+    DB::cleanup();
+
+    return 0;
+}
+
+// ============================================================ //
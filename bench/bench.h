@@ -0,0 +1,81 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <time.h>
+
+// ============================================================ //
+// Benchmark helpers
+// ============================================================ //
+
+/*
+ * Shared by the programs in bench/. Every program takes its
+ * parameters as positional arguments with defaults, prints one
+ * line per measured variant and exits with 0.
+ */
+
+namespace Bench
+{
+    // monotonic time in nanoseconds
+
+    inline uint64_t now()
+    {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    // positional argument i, or def if it is missing
+
+    inline uint64_t argument(int argc, char **argv, int i, uint64_t def)
+    {
+        if (i < argc) {
+
+            return strtoull(argv[i], nullptr, 10);
+        }
+
+        return def;
+    }
+
+    inline double seconds(uint64_t begin, uint64_t end)
+    {
+        return (end - begin) / 1e9;
+    }
+}
+
+// ============================================================ //
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,247 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "bench.h"
+#include "ioservicepool.h"
+
+#include <boost/asio/coroutine.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include <future>
+#include <vector>
+
+// ============================================================ //
+
+/*
+ * Logins made of a number of DB steps, each one a query that
+ * sleeps for the given latency on the DB executor threads. The
+ * blocking handler runs the queries on the session's I/O thread,
+ * as the handlers did before Task. The coroutine handler awaits
+ * every query the way Task::await does and resumes on the
+ * session strand, so the I/O threads stay free.
+ */
+
+// ============================================================ //
+
+struct Setup
+{
+    IO_SERVICE_POOL ioPool;
+
+    boost::asio::io_service db;
+
+    uint32_t steps;
+
+    uint32_t latency;
+
+    std::atomic<uint32_t> remaining;
+
+    std::promise<void> finished;
+
+    void query()
+    {
+        boost::this_thread::sleep_for(boost::chrono::microseconds(latency));
+    }
+
+    void done()
+    {
+        if (remaining.fetch_sub(1) == 1) {
+
+            finished.set_value();
+        }
+    }
+};
+
+// ============================================================ //
+
+void blockingLogin(Setup &setup)
+{
+    for (uint32_t i=0; i<setup.steps; ++i) {
+
+        setup.query();
+    }
+
+    setup.done();
+}
+
+// ============================================================ //
+
+#include <boost/asio/yield.hpp>
+
+class LoginTask : public boost::asio::coroutine, public boost::enable_shared_from_this<LoginTask>
+{
+public:
+
+    typedef boost::shared_ptr<LoginTask> Pointer;
+
+    static Pointer create(Setup &setup, boost::asio::io_service &io_service)
+    {
+        return Pointer(new LoginTask(setup, io_service));
+    }
+
+    void operator()()
+    {
+        reenter (this) {
+
+            for (m_step=0; m_step<m_setup.steps; ++m_step) {
+
+                yield await();
+            }
+
+            m_setup.done();
+        }
+    }
+
+protected:
+
+    LoginTask(Setup &setup, boost::asio::io_service &io_service)
+        : m_setup(setup),
+          m_strand(io_service),
+          m_step(0)
+    {
+
+    }
+
+    void await()
+    {
+        Pointer self = shared_from_this();
+
+        m_setup.db.post([self] () {
+
+            self->m_setup.query();
+
+            self->m_strand.post([self] () {
+
+                (*self)();
+            });
+        });
+    }
+
+protected:
+
+    Setup &m_setup;
+
+    boost::asio::io_service::strand m_strand;
+
+    uint32_t m_step;
+};
+
+#include <boost/asio/unyield.hpp>
+
+// ============================================================ //
+
+// logins per second with all of them started at once
+
+double run(bool coroutine, uint32_t numIoThreads, uint32_t numDbThreads, uint32_t logins, uint32_t steps, uint32_t latency)
+{
+    Setup setup;
+
+    setup.ioPool = IoServicePool::create(numIoThreads, 1);
+
+    setup.steps = steps;
+
+    setup.latency = latency;
+
+    setup.remaining = logins;
+
+    boost::shared_ptr<boost::asio::io_service::work> work = boost::make_shared<boost::asio::io_service::work>(setup.db);
+
+    boost::thread_group dbThreads;
+
+    for (uint32_t i=0; i<numDbThreads; ++i) {
+
+        dbThreads.create_thread([&setup] () {
+
+            setup.db.run();
+        });
+    }
+
+    setup.ioPool->run();
+
+    uint64_t begin = Bench::now();
+
+    for (uint32_t i=0; i<logins; ++i) {
+
+        boost::asio::io_service &io_service = setup.ioPool->select()->io_service();
+
+        if (coroutine) {
+
+            LoginTask::Pointer task = LoginTask::create(setup, io_service);
+
+            io_service.post([task] () {
+
+                (*task)();
+            });
+        }
+        else {
+
+            io_service.post(boost::bind(&blockingLogin, boost::ref(setup)));
+        }
+    }
+
+    setup.finished.get_future().wait();
+
+    uint64_t end = Bench::now();
+
+    setup.ioPool->release();
+
+    setup.ioPool->join();
+
+    work.reset();
+
+    dbThreads.join_all();
+
+    return logins / Bench::seconds(begin, end);
+}
+
+// ============================================================ //
+
+// usage: bench_coroutine [io threads] [db threads] [logins] [steps] [query latency in us]
+
+int main(int argc, char **argv)
+{
+    uint32_t numIoThreads = Bench::argument(argc, argv, 1, 2);
+
+    uint32_t numDbThreads = Bench::argument(argc, argv, 2, 32);
+
+    uint32_t logins = Bench::argument(argc, argv, 3, 2000);
+
+    uint32_t steps = Bench::argument(argc, argv, 4, 3);
+
+    uint32_t latency = Bench::argument(argc, argv, 5, 1000);
+
+    printf("io threads %u, db threads %u, logins %u, %u steps of %u us\n", numIoThreads, numDbThreads, logins, steps, latency);
+
+    printf("blocking    %10.0f logins/s\n", run(false, numIoThreads, numDbThreads, logins, steps, latency));
+
+    printf("coroutine   %10.0f logins/s\n", run(true, numIoThreads, numDbThreads, logins, steps, latency));
+
+    return 0;
+}
+
+// ============================================================ //
@@ -0,0 +1,156 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "bench.h"
+#include "db.h"
+
+#include "Zway/core/request.h"
+
+#include <vector>
+
+// ============================================================ //
+
+/*
+ * Latency of storing one push request for a growing number of
+ * recipients against the mongod on 127.0.0.1, once with an
+ * insert per recipient as processPushRequest did and once with
+ * DB::addRequests. The recipients are ids from the top of the
+ * id range and the documents are removed again after each run.
+ */
+
+// ============================================================ //
+
+#define FIRST_RECIPIENT 0xfff00000
+
+// ============================================================ //
+
+std::vector<mongo::BSONObj> requests(uint32_t requestId, uint32_t numRecipients)
+{
+    std::vector<mongo::BSONObj> res;
+
+    for (uint32_t i=0; i<numRecipients; ++i) {
+
+        res.push_back(
+                BSON(
+                    "id"   << requestId <<
+                    "type" << Zway::Request::Push <<
+                    "time" << 0 <<
+                    "ttl"  << 0 <<
+                    "src"  << FIRST_RECIPIENT - 1 <<
+                    "dst"  << FIRST_RECIPIENT + i <<
+                    "data" << BSON("bench" << true)));
+    }
+
+    return res;
+}
+
+void removeRequests(uint32_t requestId)
+{
+    DB::Connection::LOCK lock = DB::acquire();
+
+    try {
+
+        lock->db()->remove("zway.requests", BSON("id" << requestId));
+    }
+    catch (std::exception &e) {
+
+        fprintf(stderr, "Failed to remove requests: %s\n", e.what());
+    }
+}
+
+// mean milliseconds per fan-out
+
+double run(bool bulk, uint32_t numRecipients, uint32_t rounds)
+{
+    uint64_t elapsed = 0;
+
+    for (uint32_t r=0; r<rounds; ++r) {
+
+        uint32_t requestId = FIRST_RECIPIENT - 1 - r;
+
+        std::vector<mongo::BSONObj> data = requests(requestId, numRecipients);
+
+        uint64_t begin = Bench::now();
+
+        if (bulk) {
+
+            std::vector<size_t> stored;
+
+            DB::addRequests(data, stored);
+        }
+        else {
+
+            for (const mongo::BSONObj &obj : data) {
+
+                DB::addRequest(obj);
+            }
+        }
+
+        elapsed += Bench::now() - begin;
+
+        removeRequests(requestId);
+    }
+
+    return elapsed / 1e6 / rounds;
+}
+
+// ============================================================ //
+
+// usage: bench_fanout [rounds]
+
+int main(int argc, char **argv)
+{
+    uint32_t rounds = std::max<uint64_t>(1, Bench::argument(argc, argv, 1, 20));
+
+    if (!DB::startup("127.0.0.1")) {
+
+        fprintf(stderr, "Failed to connect to mongod on 127.0.0.1\n");
+
+        return 1;
+    }
+
+    printf("rounds %u\n", rounds);
+
+    printf("recipients   insert each   bulk insert\n");
+
+    for (uint32_t numRecipients : {1, 5, 10, 50, 100, 500}) {
+
+        double each = run(false, numRecipients, rounds);
+
+        double bulk = run(true, numRecipients, rounds);
+
+        printf("%10u   %8.2f ms   %8.2f ms\n", numRecipients, each, bulk);
+    }
+
+    DB::cleanup();
+
+    return 0;
+}
+
+// ============================================================ //
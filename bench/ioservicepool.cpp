@@ -0,0 +1,258 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "bench.h"
+#include "ioservicepool.h"
+#include "thread.h"
+
+#include <boost/asio/local/connect_pair.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include <future>
+#include <vector>
+
+// ============================================================ //
+
+#define MESSAGE_SIZE 64
+
+// ============================================================ //
+// EchoSession
+// ============================================================ //
+
+/*
+ * Client and server end of a local socket pair on one shard.
+ * The server end runs its handlers through a strand and takes a
+ * ThreadSafe lock per read, as ClientSession does. The client
+ * sends a message, waits for the echo and repeats.
+ */
+
+class EchoSession : public boost::enable_shared_from_this<EchoSession>
+{
+public:
+
+    typedef boost::shared_ptr<EchoSession> Pointer;
+
+    static Pointer create(boost::asio::io_service &io_service, uint32_t roundTrips, std::atomic<uint32_t> &remaining, std::promise<void> &finished)
+    {
+        return Pointer(new EchoSession(io_service, roundTrips, remaining, finished));
+    }
+
+    void start()
+    {
+        serverRead();
+
+        clientWrite();
+    }
+
+protected:
+
+    EchoSession(boost::asio::io_service &io_service, uint32_t roundTrips, std::atomic<uint32_t> &remaining, std::promise<void> &finished)
+        : m_server(io_service),
+          m_client(io_service),
+          m_strand(io_service),
+          m_bytes(0, LockName("EchoSession::m_bytes")),
+          m_roundTrips(roundTrips),
+          m_done(0),
+          m_remaining(remaining),
+          m_finished(finished)
+    {
+        boost::asio::local::connect_pair(m_server, m_client);
+    }
+
+    void serverRead()
+    {
+        m_server.async_read_some(
+                    boost::asio::buffer(m_serverData),
+                    m_strand.wrap(boost::bind(&EchoSession::handleServerRead, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+    }
+
+    void handleServerRead(const boost::system::error_code &err, size_t bytesRead)
+    {
+        if (err) {
+
+            return;
+        }
+
+        {
+            ThreadSafeMutex::scoped_lock locker(m_bytes);
+
+            *m_bytes += bytesRead;
+        }
+
+        boost::asio::async_write(
+                    m_server,
+                    boost::asio::buffer(m_serverData, bytesRead),
+                    m_strand.wrap(boost::bind(&EchoSession::handleServerWrite, shared_from_this(), boost::asio::placeholders::error)));
+    }
+
+    void handleServerWrite(const boost::system::error_code &err)
+    {
+        if (!err) {
+
+            serverRead();
+        }
+    }
+
+    void clientWrite()
+    {
+        boost::asio::async_write(
+                    m_client,
+                    boost::asio::buffer(m_clientData),
+                    boost::bind(&EchoSession::handleClientWrite, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    void handleClientWrite(const boost::system::error_code &err)
+    {
+        if (err) {
+
+            return;
+        }
+
+        boost::asio::async_read(
+                    m_client,
+                    boost::asio::buffer(m_clientData),
+                    boost::bind(&EchoSession::handleClientRead, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    void handleClientRead(const boost::system::error_code &err)
+    {
+        if (err) {
+
+            return;
+        }
+
+        if (++m_done < m_roundTrips) {
+
+            clientWrite();
+
+            return;
+        }
+
+        // the server end sees eof and lets go of the session
+
+        m_client.close();
+
+        if (m_remaining.fetch_sub(1) == 1) {
+
+            m_finished.set_value();
+        }
+    }
+
+protected:
+
+    boost::asio::local::stream_protocol::socket m_server;
+
+    boost::asio::local::stream_protocol::socket m_client;
+
+    boost::asio::io_service::strand m_strand;
+
+    ThreadSafe<uint64_t> m_bytes;
+
+    uint8_t m_serverData[MESSAGE_SIZE];
+
+    uint8_t m_clientData[MESSAGE_SIZE];
+
+    uint32_t m_roundTrips;
+
+    uint32_t m_done;
+
+    std::atomic<uint32_t> &m_remaining;
+
+    std::promise<void> &m_finished;
+};
+
+// ============================================================ //
+
+// runs all sessions to completion on the pool, returns seconds
+
+double run(IO_SERVICE_POOL pool, uint32_t numSessions, uint32_t roundTrips)
+{
+    std::atomic<uint32_t> remaining(numSessions);
+
+    std::promise<void> finished;
+
+    std::vector<EchoSession::Pointer> sessions;
+
+    for (uint32_t i=0; i<numSessions; ++i) {
+
+        sessions.push_back(EchoSession::create(pool->select()->io_service(), roundTrips, remaining, finished));
+    }
+
+    pool->run();
+
+    uint64_t begin = Bench::now();
+
+    for (EchoSession::Pointer &session : sessions) {
+
+        session->start();
+    }
+
+    sessions.clear();
+
+    finished.get_future().wait();
+
+    uint64_t end = Bench::now();
+
+    pool->release();
+
+    pool->join();
+
+    return Bench::seconds(begin, end);
+}
+
+// ============================================================ //
+
+// usage: bench_ioservicepool [workers] [sessions] [round trips]
+
+int main(int argc, char **argv)
+{
+    uint32_t numWorkers = Bench::argument(argc, argv, 1, std::max(1u, boost::thread::hardware_concurrency()));
+
+    uint32_t numSessions = Bench::argument(argc, argv, 2, 256);
+
+    uint32_t roundTrips = Bench::argument(argc, argv, 3, 2000);
+
+    // the two modes main.cpp sets up, --shared-io and the default
+
+    double shared = run(IoServicePool::create(1, numWorkers), numSessions, roundTrips);
+
+    double sharded = run(IoServicePool::create(numWorkers, 1), numSessions, roundTrips);
+
+    double total = (double)numSessions * roundTrips;
+
+    printf("workers %u, sessions %u, round trips per session %u\n", numWorkers, numSessions, roundTrips);
+
+    printf("shared io_service   %12.0f round trips/s\n", total / shared);
+
+    printf("per-core shards     %12.0f round trips/s\n", total / sharded);
+
+    return 0;
+}
+
+// ============================================================ //
@@ -0,0 +1,129 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "bench.h"
+#include "packetpool.h"
+
+#include <boost/thread.hpp>
+
+#include <vector>
+
+// ============================================================ //
+
+// body sizes cycled through, mostly full stream chunks
+// with some small request and status packets in between
+
+static const size_t bodySizes[] = {
+    Zway::MAX_PACKET_BODY,
+    Zway::MAX_PACKET_BODY,
+    Zway::MAX_PACKET_BODY,
+    64,
+    256,
+    1024
+};
+
+#define NUM_BODY_SIZES (sizeof(bodySizes) / sizeof(bodySizes[0]))
+
+// ============================================================ //
+
+// allocates packets with a body each and keeps the last
+// window of them alive, like packets queued in a session
+
+template <class Allocator>
+void worker(Allocator allocate, uint32_t iterations, uint32_t window)
+{
+    std::vector<std::pair<Zway::PACKET, Zway::BUFFER>> live(window);
+
+    for (uint32_t i=0; i<iterations; ++i) {
+
+        live[i % window] = allocate(bodySizes[i % NUM_BODY_SIZES]);
+    }
+}
+
+template <class Allocator>
+double run(Allocator allocate, uint32_t numThreads, uint32_t iterations, uint32_t window)
+{
+    boost::thread_group threads;
+
+    uint64_t begin = Bench::now();
+
+    for (uint32_t i=0; i<numThreads; ++i) {
+
+        threads.create_thread(boost::bind(&worker<Allocator>, allocate, iterations, window));
+    }
+
+    threads.join_all();
+
+    uint64_t end = Bench::now();
+
+    return (double)numThreads * iterations / Bench::seconds(begin, end);
+}
+
+// ============================================================ //
+
+std::pair<Zway::PACKET, Zway::BUFFER> unpooled(size_t size)
+{
+    return std::make_pair(Zway::Packet::create(), Zway::Buffer::create(nullptr, size));
+}
+
+std::pair<Zway::PACKET, Zway::BUFFER> pooled(size_t size)
+{
+    return std::make_pair(PacketPool::createPacket(), PacketPool::createBuffer(size));
+}
+
+// ============================================================ //
+
+// usage: bench_packetpool [threads] [iterations] [window]
+
+int main(int argc, char **argv)
+{
+    uint32_t numThreads = Bench::argument(argc, argv, 1, std::max(1u, boost::thread::hardware_concurrency()));
+
+    uint32_t iterations = Bench::argument(argc, argv, 2, 1000000);
+
+    uint32_t window = std::max<uint32_t>(1, Bench::argument(argc, argv, 3, 64));
+
+    printf("threads %u, iterations %u, window %u\n", numThreads, iterations, window);
+
+    printf("unpooled   %12.0f packets/s\n", run(&unpooled, numThreads, iterations, window));
+
+    printf("pooled     %12.0f packets/s\n", run(&pooled, numThreads, iterations, window));
+
+    PacketPool::Stats packets = PacketPool::packetStats();
+
+    PacketPool::Stats buffers = PacketPool::bufferStats();
+
+    printf("packets    hits %lu, misses %lu, high water %lu\n", packets.hits, packets.misses, packets.highWater);
+
+    printf("buffers    hits %lu, misses %lu, high water %lu\n", buffers.hits, buffers.misses, buffers.highWater);
+
+    return 0;
+}
+
+// ============================================================ //
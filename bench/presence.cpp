@@ -0,0 +1,256 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "bench.h"
+#include "presence.h"
+#include "sessionregistry.h"
+
+#include <boost/thread.hpp>
+
+#include <random>
+#include <vector>
+
+// ============================================================ //
+
+/*
+ * Status fan-out with every user online. Each user has one
+ * session and about the given number of contacts, all of them
+ * watched and sharing their status. A broadcast visits the
+ * watching sessions of a random user, the way broadcastStatus
+ * does, with three lookups:
+ *
+ *   presence        Presence::visitWatchers, one shard lock
+ *   registry        SessionRegistry::visit for every contact
+ *   global mutex    one mutex and a copied session list for
+ *                   every contact, as Server::getSessions did
+ *
+ * Sessions are stand-in handles that are never dereferenced,
+ * a real ClientSession holds a 64k receive buffer.
+ */
+
+// ============================================================ //
+
+struct Population
+{
+    std::vector<std::set<uint32_t>> contacts;
+
+    std::vector<CLIENT_SESSION> sessions;
+
+    Presence presence;
+
+    SessionRegistry registry;
+
+    boost::mutex mutex;
+
+    CLIENT_SESSION_MAP map;
+};
+
+// ============================================================ //
+
+// account ids start at 1, contacts are symmetric
+
+void populate(Population &p, uint32_t numUsers, uint32_t numContacts)
+{
+    p.contacts.resize(numUsers + 1);
+
+    p.sessions.resize(numUsers + 1);
+
+    std::mt19937 rng(1);
+
+    std::uniform_int_distribution<uint32_t> user(1, numUsers);
+
+    for (uint32_t u=1; u<=numUsers; ++u) {
+
+        for (uint32_t i=0; i<numContacts/2; ++i) {
+
+            uint32_t v = user(rng);
+
+            if (v != u) {
+
+                p.contacts[u].insert(v);
+
+                p.contacts[v].insert(u);
+            }
+        }
+
+        // one owner per handle, shared_ptr ordering compares owners
+
+        boost::shared_ptr<char> handle = boost::make_shared<char>();
+
+        p.sessions[u] = CLIENT_SESSION(handle, reinterpret_cast<ClientSession*>(handle.get()));
+    }
+
+    for (uint32_t u=1; u<=numUsers; ++u) {
+
+        p.presence.attach(u);
+
+        p.presence.setAudience(u, p.contacts[u]);
+
+        p.presence.setVisible(u, true);
+
+        p.presence.subscribe(p.sessions[u], u, p.contacts[u]);
+
+        p.registry.append(u, p.sessions[u]);
+
+        p.map[u].push_back(p.sessions[u]);
+    }
+}
+
+// ============================================================ //
+
+enum Lookup
+{
+    PresenceLookup,
+    RegistryLookup,
+    GlobalMutexLookup
+};
+
+void worker(Population &p, Lookup lookup, uint32_t seed, uint32_t broadcasts, std::atomic<uint64_t> &visited)
+{
+    std::mt19937 rng(seed);
+
+    std::uniform_int_distribution<uint32_t> user(1, p.contacts.size() - 1);
+
+    uint64_t res = 0;
+
+    auto visitor = [&res] (const CLIENT_SESSION &session) {
+
+        res += session != nullptr;
+    };
+
+    for (uint32_t i=0; i<broadcasts; ++i) {
+
+        uint32_t u = user(rng);
+
+        switch (lookup) {
+
+            case PresenceLookup:
+
+                p.presence.visitWatchers(u, visitor);
+
+                break;
+
+            case RegistryLookup:
+
+                for (uint32_t contactId : p.contacts[u]) {
+
+                    p.registry.visit(contactId, visitor);
+                }
+
+                break;
+
+            case GlobalMutexLookup:
+
+                for (uint32_t contactId : p.contacts[u]) {
+
+                    CLIENT_SESSION_LIST sessions;
+
+                    {
+                        boost::mutex::scoped_lock locker(p.mutex);
+
+                        auto it = p.map.find(contactId);
+
+                        if (it != p.map.end()) {
+
+                            sessions = it->second;
+                        }
+                    }
+
+                    for (const CLIENT_SESSION &session : sessions) {
+
+                        visitor(session);
+                    }
+                }
+
+                break;
+        }
+    }
+
+    visited += res;
+}
+
+// broadcasts per second, visited receives the sessions reached
+
+double run(Population &p, Lookup lookup, uint32_t numThreads, uint32_t broadcasts, uint64_t &visited)
+{
+    std::atomic<uint64_t> count(0);
+
+    boost::thread_group threads;
+
+    uint64_t begin = Bench::now();
+
+    for (uint32_t i=0; i<numThreads; ++i) {
+
+        threads.create_thread(boost::bind(&worker, boost::ref(p), lookup, i + 1, broadcasts, boost::ref(count)));
+    }
+
+    threads.join_all();
+
+    uint64_t end = Bench::now();
+
+    visited = count;
+
+    return (double)numThreads * broadcasts / Bench::seconds(begin, end);
+}
+
+// ============================================================ //
+
+// usage: bench_presence [threads] [users] [contacts] [broadcasts per thread]
+
+int main(int argc, char **argv)
+{
+    uint32_t numThreads = Bench::argument(argc, argv, 1, std::max(1u, boost::thread::hardware_concurrency()));
+
+    uint32_t numUsers = std::max<uint64_t>(2, Bench::argument(argc, argv, 2, 100000));
+
+    uint32_t numContacts = Bench::argument(argc, argv, 3, 50);
+
+    uint32_t broadcasts = Bench::argument(argc, argv, 4, 20000);
+
+    Population p;
+
+    populate(p, numUsers, numContacts);
+
+    printf("threads %u, users %u, contacts %u, broadcasts per thread %u\n", numThreads, numUsers, numContacts, broadcasts);
+
+    const char *names[] = {"presence", "registry", "global mutex"};
+
+    for (Lookup lookup : {PresenceLookup, RegistryLookup, GlobalMutexLookup}) {
+
+        uint64_t visited = 0;
+
+        double rate = run(p, lookup, numThreads, broadcasts, visited);
+
+        printf("%-14s %10.0f broadcasts/s, %lu sessions reached\n", names[lookup], rate, visited);
+    }
+
+    return 0;
+}
+
+// ============================================================ //
@@ -0,0 +1,272 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "bench.h"
+#include "streambuffer.h"
+
+#include <boost/thread.hpp>
+
+#include <vector>
+
+// ============================================================ //
+
+/*
+ * An upload written chunk by chunk into an in-memory stream
+ * buffer while senders read it behind the writer, so the cost
+ * is the per-chunk bookkeeping rather than file I/O. The locked
+ * variant does the bookkeeping with ThreadSafe members the way
+ * StreamBuffer did before Atomic, the other one is StreamBuffer.
+ */
+
+// ============================================================ //
+
+class BenchStreamBuffer : public StreamBuffer
+{
+public:
+
+    typedef std::shared_ptr<BenchStreamBuffer> Pointer;
+
+    static Pointer create(uint32_t parts, bool locked)
+    {
+        Pointer buffer(new BenchStreamBuffer(locked));
+
+        buffer->m_streamId = 1;
+
+        buffer->m_streamParts = parts;
+
+        if (!buffer->init(std::string())) {
+
+            return nullptr;
+        }
+
+        // fault the pages in before the clock starts
+
+        memset(buffer->m_buffer->data(), 0, buffer->m_buffer->size());
+
+        return buffer;
+    }
+
+    bool read(uint8_t *data, size_t size, size_t offset=0, size_t *bytesRead = nullptr)
+    {
+        if (!m_locked) {
+
+            return StreamBuffer::read(data, size, offset, bytesRead);
+        }
+
+        size_t bytesToRead = 0;
+
+        size_t br = lockedBytesReadable();
+
+        if (offset < br) {
+
+            bytesToRead = br - offset > size ? size : br - offset;
+        }
+
+        if (bytesToRead) {
+
+            if (!m_buffer->read(data, bytesToRead, offset, bytesRead)) {
+
+                return false;
+            }
+        }
+        else
+        if (bytesRead) {
+
+            *bytesRead = 0;
+        }
+
+        {
+            ThreadSafeMutex::scoped_lock lock(m_lockedLastActivity);
+
+            m_lockedLastActivity = time(nullptr);
+        }
+
+        return true;
+    }
+
+    bool write(const uint8_t *data, size_t size, size_t offset=0, size_t *bytesWritten = nullptr)
+    {
+        if (!m_locked) {
+
+            return StreamBuffer::write(data, size, offset, bytesWritten);
+        }
+
+        size_t bw = 0;
+
+        size_t br = lockedBytesReadable();
+
+        if (!m_buffer->write(data, size, br, &bw)) {
+
+            return false;
+        }
+
+        {
+            ThreadSafeMutex::scoped_lock lock(m_lockedBytesReadable);
+
+            *m_lockedBytesReadable += bw;
+        }
+
+        if (bytesWritten) {
+
+            *bytesWritten = bw;
+        }
+
+        {
+            ThreadSafeMutex::scoped_lock lock(m_lockedLastActivity);
+
+            m_lockedLastActivity = time(nullptr);
+        }
+
+        return true;
+    }
+
+protected:
+
+    BenchStreamBuffer(bool locked)
+        : m_locked(locked),
+          m_lockedBytesReadable(0),
+          m_lockedLastActivity(0)
+    {
+
+    }
+
+    uint64_t lockedBytesReadable()
+    {
+        ThreadSafeMutex::scoped_lock lock(m_lockedBytesReadable);
+
+        return m_lockedBytesReadable;
+    }
+
+protected:
+
+    bool m_locked;
+
+    ThreadSafe<uint64_t> m_lockedBytesReadable;
+
+    ThreadSafe<uint64_t> m_lockedLastActivity;
+};
+
+// ============================================================ //
+
+void writer(BenchStreamBuffer::Pointer buffer, uint32_t parts)
+{
+    std::vector<uint8_t> chunk(Zway::MAX_PACKET_BODY, 0x5a);
+
+    for (uint32_t i=0; i<parts; ++i) {
+
+        size_t bw = 0;
+
+        buffer->write(chunk.data(), chunk.size(), 0, &bw);
+    }
+}
+
+// reads like a sender, retrying until the next chunk is there
+
+void reader(BenchStreamBuffer::Pointer buffer, uint32_t parts)
+{
+    std::vector<uint8_t> chunk(Zway::MAX_PACKET_BODY);
+
+    size_t offset = 0;
+
+    size_t total = (size_t)parts * Zway::MAX_PACKET_BODY;
+
+    while (offset < total) {
+
+        size_t br = 0;
+
+        if (!buffer->read(chunk.data(), chunk.size(), offset, &br)) {
+
+            return;
+        }
+
+        if (!br) {
+
+            boost::this_thread::yield();
+        }
+
+        offset += br;
+    }
+}
+
+// nanoseconds per chunk, written once and read by every reader
+
+double run(bool locked, uint32_t numReaders, uint32_t parts, uint32_t rounds)
+{
+    uint64_t elapsed = 0;
+
+    for (uint32_t r=0; r<rounds; ++r) {
+
+        BenchStreamBuffer::Pointer buffer = BenchStreamBuffer::create(parts, locked);
+
+        if (!buffer) {
+
+            return 0;
+        }
+
+        boost::thread_group threads;
+
+        uint64_t begin = Bench::now();
+
+        for (uint32_t i=0; i<numReaders; ++i) {
+
+            threads.create_thread(boost::bind(&reader, buffer, parts));
+        }
+
+        threads.create_thread(boost::bind(&writer, buffer, parts));
+
+        threads.join_all();
+
+        elapsed += Bench::now() - begin;
+    }
+
+    return (double)elapsed / ((double)rounds * parts);
+}
+
+// ============================================================ //
+
+// usage: bench_streambuffer [readers] [parts] [rounds]
+
+int main(int argc, char **argv)
+{
+    uint32_t numReaders = Bench::argument(argc, argv, 1, 2);
+
+    uint32_t parts = std::max<uint64_t>(1, Bench::argument(argc, argv, 2, 4096));
+
+    uint32_t rounds = std::max<uint64_t>(1, Bench::argument(argc, argv, 3, 10));
+
+    printf("readers %u, parts %u of %u bytes, rounds %u\n", numReaders, parts, (uint32_t)Zway::MAX_PACKET_BODY, rounds);
+
+    printf("ThreadSafe bookkeeping   %10.1f ns/chunk\n", run(true, numReaders, parts, rounds));
+
+    printf("Atomic bookkeeping       %10.1f ns/chunk\n", run(false, numReaders, parts, rounds));
+
+    return 0;
+}
+
+// ============================================================ //
@@ -0,0 +1,287 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "bench.h"
+#include "tlssessioncache.h"
+
+#include <boost/asio/ssl.hpp>
+#include <boost/thread.hpp>
+
+#include <openssl/x509.h>
+
+#include <atomic>
+
+// ============================================================ //
+
+// self-signed rsa certificate, so the benchmark needs no files
+
+bool useGeneratedCertificate(SSL_CTX *ctx)
+{
+    EVP_PKEY *key = nullptr;
+
+    EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+
+    if (!pctx || EVP_PKEY_keygen_init(pctx) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(pctx, 2048) <= 0 || EVP_PKEY_keygen(pctx, &key) <= 0) {
+
+        EVP_PKEY_CTX_free(pctx);
+
+        return false;
+    }
+
+    EVP_PKEY_CTX_free(pctx);
+
+    X509 *cert = X509_new();
+
+    X509_set_version(cert, 2);
+
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+
+    X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+
+    X509_set_pubkey(cert, key);
+
+    X509_NAME *name = X509_get_subject_name(cert);
+
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"zway-bench", -1, -1, 0);
+
+    X509_set_issuer_name(cert, name);
+
+    bool res =
+            X509_sign(cert, key, EVP_sha256()) &&
+            SSL_CTX_use_certificate(ctx, cert) == 1 &&
+            SSL_CTX_use_PrivateKey(ctx, key) == 1;
+
+    X509_free(cert);
+
+    EVP_PKEY_free(key);
+
+    return res;
+}
+
+// ============================================================ //
+
+// one handshake over a bio pair, offers session if set and
+// replaces it with the one the server handed out
+
+bool handshake(SSL_CTX *serverCtx, SSL_CTX *clientCtx, SSL_SESSION **session)
+{
+    SSL *server = SSL_new(serverCtx);
+
+    SSL *client = SSL_new(clientCtx);
+
+    BIO *serverBio = nullptr;
+
+    BIO *clientBio = nullptr;
+
+    BIO_new_bio_pair(&serverBio, 0, &clientBio, 0);
+
+    SSL_set_bio(server, serverBio, serverBio);
+
+    SSL_set_bio(client, clientBio, clientBio);
+
+    SSL_set_accept_state(server);
+
+    SSL_set_connect_state(client);
+
+    if (session && *session) {
+
+        SSL_set_session(client, *session);
+    }
+
+    bool serverDone = false;
+
+    bool clientDone = false;
+
+    bool failed = false;
+
+    while (!failed && !(serverDone && clientDone)) {
+
+        int r;
+
+        if (!clientDone && (r = SSL_do_handshake(client)) != 1) {
+
+            int err = SSL_get_error(client, r);
+
+            failed = err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE;
+        }
+        else {
+
+            clientDone = true;
+        }
+
+        if (!serverDone && (r = SSL_do_handshake(server)) != 1) {
+
+            int err = SSL_get_error(server, r);
+
+            failed = failed || (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE);
+        }
+        else {
+
+            serverDone = true;
+        }
+    }
+
+    if (!failed) {
+
+        TlsSessionCache::handshakeCompleted(server);
+
+        // with tls 1.3 the tickets follow the handshake
+
+        uint8_t byte;
+
+        SSL_read(client, &byte, 1);
+
+        if (session) {
+
+            SSL_SESSION_free(*session);
+
+            *session = SSL_get1_session(client);
+        }
+    }
+
+    // without a close_notify openssl drops the session from the
+    // caches and marks it not resumable
+
+    SSL_shutdown(client);
+
+    SSL_shutdown(server);
+
+    SSL_free(client);
+
+    SSL_free(server);
+
+    return !failed;
+}
+
+// ============================================================ //
+
+void worker(SSL_CTX *serverCtx, SSL_CTX *clientCtx, bool resume, uint32_t count, std::atomic<uint32_t> &failures)
+{
+    SSL_SESSION *session = nullptr;
+
+    for (uint32_t i=0; i<count; ++i) {
+
+        if (!handshake(serverCtx, clientCtx, resume ? &session : nullptr)) {
+
+            failures++;
+        }
+    }
+
+    SSL_SESSION_free(session);
+}
+
+// handshakes per second, the counters tell how many were resumed
+
+double run(SSL_CTX *serverCtx, SSL_CTX *clientCtx, bool resume, uint32_t numThreads, uint32_t count)
+{
+    std::atomic<uint32_t> failures(0);
+
+    boost::thread_group threads;
+
+    uint64_t begin = Bench::now();
+
+    for (uint32_t i=0; i<numThreads; ++i) {
+
+        threads.create_thread(boost::bind(&worker, serverCtx, clientCtx, resume, count, boost::ref(failures)));
+    }
+
+    threads.join_all();
+
+    uint64_t end = Bench::now();
+
+    if (failures) {
+
+        fprintf(stderr, "%u handshake(s) failed\n", failures.load());
+    }
+
+    return (double)numThreads * count / Bench::seconds(begin, end);
+}
+
+// ============================================================ //
+
+// usage: bench_tlshandshake [threads] [handshakes per thread]
+
+int main(int argc, char **argv)
+{
+    uint32_t numThreads = Bench::argument(argc, argv, 1, std::max(1u, boost::thread::hardware_concurrency()));
+
+    uint32_t count = Bench::argument(argc, argv, 2, 500);
+
+    // the server context is set up like in Server::start
+
+    boost::asio::ssl::context serverContext(boost::asio::ssl::context::sslv23);
+
+    serverContext.set_options(
+            boost::asio::ssl::context::default_workarounds|
+            boost::asio::ssl::context::no_sslv2|
+            boost::asio::ssl::context::no_sslv3|
+            boost::asio::ssl::context::single_dh_use);
+
+    if (!useGeneratedCertificate(serverContext.native_handle())) {
+
+        fprintf(stderr, "Failed to create certificate\n");
+
+        return 1;
+    }
+
+    if (!TlsSessionCache::startup(serverContext.native_handle(), TLS_SESSION_CACHE_SIZE, TLS_TICKET_LIFETIME)) {
+
+        fprintf(stderr, "Failed to init tls session cache\n");
+
+        return 1;
+    }
+
+    boost::asio::ssl::context clientContext(boost::asio::ssl::context::sslv23);
+
+    clientContext.set_verify_mode(boost::asio::ssl::verify_none);
+
+    printf("threads %u, handshakes per thread %u\n", numThreads, count);
+
+    double full = run(serverContext.native_handle(), clientContext.native_handle(), false, numThreads, count);
+
+    uint64_t numFull = TlsSessionCache::numFullHandshakes();
+
+    uint64_t numResumed = TlsSessionCache::numResumedHandshakes();
+
+    printf("without resumption %10.0f handshakes/s, %lu full, %lu resumed\n", full, numFull, numResumed);
+
+    double resumed = run(serverContext.native_handle(), clientContext.native_handle(), true, numThreads, count);
+
+    numFull = TlsSessionCache::numFullHandshakes() - numFull;
+
+    numResumed = TlsSessionCache::numResumedHandshakes() - numResumed;
+
+    printf("with resumption    %10.0f handshakes/s, %lu full, %lu resumed\n", resumed, numFull, numResumed);
+
+    return 0;
+}
+
+// ============================================================ //
@@ -0,0 +1,118 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef ACCOUNT_CACHE_H_
+#define ACCOUNT_CACHE_H_
+
+#include "sharded.h"
+
+#include <mongo/client/dbclient.h>
+
+#include <atomic>
+#include <list>
+#include <unordered_map>
+
+// ============================================================ //
+
+#define ACCOUNT_CACHE_SIZE 100000
+
+#define ACCOUNT_CACHE_TTL 300
+
+#define ACCOUNT_CACHE_SHARDS 16
+
+// ============================================================ //
+// AccountCache
+// ============================================================ //
+
+/*
+ * LRU cache of account documents by account id, split into
+ * shards with their own lock. Entries expire after the ttl and
+ * are dropped by every write to the account. A lookup that
+ * missed takes the version first and passes it to put, so a
+ * document read before an invalidation is never cached after it.
+ */
+
+class AccountCache
+{
+public:
+
+    static void startup(uint32_t size, uint32_t ttl);
+
+    static bool get(uint32_t accountId, mongo::BSONObj &res);
+
+    static uint64_t version(uint32_t accountId);
+
+    static void put(uint32_t accountId, const mongo::BSONObj &obj, uint64_t version);
+
+    static void invalidate(uint32_t accountId);
+
+    static size_t size();
+
+protected:
+
+    struct Entry
+    {
+        uint32_t accountId;
+
+        mongo::BSONObj obj;
+
+        uint64_t expires;
+    };
+
+    struct Shard
+    {
+        Shard();
+
+        boost::mutex mutex;
+
+        // most recently used at the front
+
+        std::list<Entry> entries;
+
+        std::unordered_map<uint32_t, std::list<Entry>::iterator> index;
+
+        uint64_t version;
+    };
+
+    typedef Sharded<Shard, ACCOUNT_CACHE_SHARDS> Shards;
+
+    static uint64_t now();
+
+protected:
+
+    static uint32_t m_shardSize;
+
+    static uint32_t m_ttl;
+
+    static Shards m_shards;
+};
+
+// ============================================================ //
+
+#endif /* ACCOUNT_CACHE_H_ */
@@ -30,22 +30,68 @@
 #ifndef DB_H_
 #define DB_H_
 
+#include <boost/asio/io_service.hpp>
+#include <boost/function.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <mongo/client/dbclient.h>
 #include <mongo/client/gridfs.h>
 
-#include <queue>
+#include <atomic>
+#include <deque>
 
 #include <Zway/core/ubj/value.h>
 
 // ============================================================ //
 
+#define DB_MIN_CONNECTIONS 4
+
+#define DB_MAX_CONNECTIONS 25
+
+// milliseconds a query waits for a connection before it fails
+
+#define DB_ACQUIRE_TIMEOUT 10000
+
+// seconds an idle connection above the minimum is kept open
+
+#define DB_IDLE_TIMEOUT 60
+
+// account ids reserved per round trip to the counter document
+
+#define ACCOUNT_ID_BLOCK 100
+
+// ============================================================ //
+
 class DB
 {
 public:
 
+    // everything an offline notification needs
+
+    struct NotificationInfo
+    {
+        std::string fcmToken;
+
+        uint32_t numContactRequests;
+
+        uint32_t numPushRequests;
+    };
+
+    struct PoolOptions
+    {
+        PoolOptions();
+
+        uint32_t minConnections;
+
+        uint32_t maxConnections;
+
+        uint32_t acquireTimeout;
+
+        uint32_t idleTimeout;
+    };
+
     class Connection
     {
     public:
@@ -84,6 +130,10 @@ public:
 
         mongo::DBClientConnection *db();
 
+        // cheap check made before an idle connection is reused
+
+        bool healthy();
+
     protected:
 
         Connection();
@@ -97,15 +147,71 @@ public:
 
     typedef Connection::Pointer CONNECTION;
 
-    static bool startup(const std::string& address, uint32_t numConnections = 10);
+    // hands a completion back to the caller's io_service or strand
+
+    typedef boost::function<void (const boost::function<void ()>&)> Dispatcher;
+
+    static bool startup(const std::string& address, const PoolOptions &options = PoolOptions());
 
     static void cleanup();
 
+    // the pool grows on demand up to maxConnections, beyond that
+    // callers are served in arrival order. On timeout the returned
+    // lock holds no connection and its db() throws
+
     static Connection::LOCK acquire();
 
+    // closes connections idle for longer than idleTimeout and
+    // reopens lost ones up to minConnections, called periodically
+
+    static void maintain();
+
+
+    // queries are run by a dedicated executor with one thread per
+    // possible connection, so jobs posted here never queue for a
+    // connection in acquire unless other callers hold some, and
+    // io_service threads never block on the database
+
+    static void post(const boost::function<void ()> &job);
+
+    // jobs posted but not yet started and connections not in use
+
+    static uint32_t numQueuedJobs();
+
+    static uint32_t numIdleConnections();
+
+    static uint32_t numBusyConnections();
+
+    static uint32_t numConnections();
+
+    static uint32_t numWaiters();
+
+    template <class Result>
+    static void async(
+            const boost::function<Result ()> &query,
+            const boost::function<void (const Result&)> &handler,
+            const Dispatcher &dispatch)
+    {
+        post([query, handler, dispatch] () {
+
+            Result res = query();
+
+            dispatch([handler, res] () {
+
+                handler(res);
+            });
+        });
+    }
+
+
+    // ids come from blocks reserved on the zway.counters document,
+    // unique across processes, 0 on failure
 
     static uint32_t newAccountId();
 
+    // lookups by id alone for cacheable fields are answered from the
+    // AccountCache, the cached document is cut down to fieldsToReturn
+
     static bool getAccount(const mongo::BSONObj& query, const mongo::BSONObj &fieldsToReturn, mongo::BSONObj& res);
 
     static bool insertAccount(
@@ -122,6 +228,14 @@ public:
 
     static bool addRequest(const mongo::BSONObj& data);
 
+    // stores all documents with one bulk insert. the insert is not
+    // atomic, if it fails the documents are checked and inserted one
+    // by one. stored receives the indices of the documents that are
+    // in the collection, the result is true if all of them are. the
+    // request counters only count the documents inserted by the call
+
+    static bool addRequests(const std::vector<mongo::BSONObj>& data, std::vector<size_t> &stored);
+
     static bool deleteRequest(const mongo::BSONObj& query);
 
     static bool requestPending(const mongo::BSONObj& query);
@@ -146,24 +260,95 @@ public:
     static std::string getFcmToken(uint32_t accountId);
 
 
+    // pending request numbers come from RequestCounters, the
+    // token from the account cache, so at most one query is made
+
     static uint32_t numContactRequests(uint32_t accountId);
 
     static uint32_t numPushRequests(uint32_t accountId);
 
+    static bool getNotificationInfo(uint32_t accountId, NotificationInfo &info);
+
+    // rebuilds RequestCounters from zway.requests
+
+    static bool loadRequestCounters();
+
 
 protected:
 
-    static CONNECTION getConnection();
+    struct Idle
+    {
+        CONNECTION con;
+
+        uint64_t since;
+    };
+
+    // a blocked acquire, handed either a connection or
+    // the right to open one
+
+    struct Waiter
+    {
+        Waiter();
+
+        boost::condition_variable condition;
+
+        CONNECTION con;
+
+        bool slot;
+    };
+
+    static CONNECTION open();
+
+    static bool reserveAccountIds(uint32_t &begin, uint32_t &end);
+
+    static bool getCachedAccount(uint32_t accountId, mongo::BSONObj &res);
+
+    static mongo::BSONObj cachedFields();
+
+    static bool cachedFields(const mongo::BSONObj &fieldsToReturn);
+
+    static mongo::BSONObj project(const mongo::BSONObj &obj, const mongo::BSONObj &fieldsToReturn);
+
+    static void release(CONNECTION con);
+
+    static void releaseSlot();
+
+    static uint64_t now();
 
 protected:
 
     static boost::mutex m_mutex;
 
-    static boost::condition_variable m_condition;
+    static std::string m_address;
+
+    static PoolOptions m_options;
+
+    // most recently used at the back
+
+    static std::deque<Idle> m_idle;
+
+    static std::deque<Waiter*> m_waiters;
+
+    // open connections, including the ones being opened
+
+    static uint32_t m_numConnections;
+
+    static uint32_t m_numBusy;
+
+    static boost::shared_ptr<boost::asio::io_service> m_executor;
+
+    static boost::shared_ptr<boost::asio::io_service::work> m_executorWork;
+
+    static boost::thread_group m_executorThreads;
+
+    static std::atomic<uint32_t> m_queuedJobs;
+
+    // next free account id in the low and end of the reserved
+    // block in the high half, so one fetch_add sees both
 
-    static boost::mutex m_connectionsMutex;
+    static std::atomic<uint64_t> m_accountIds;
 
-    static std::queue<Connection::Pointer> m_connections;
+    static boost::mutex m_accountIdsMutex;
 };
 
 // ============================================================ //
@@ -32,10 +32,20 @@
 
 #include <curl/curl.h>
 
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+#include <atomic>
 #include <string>
 
 // ============================================================ //
 
+#define FCM_THREADS 4
+
+#define FCM_QUEUE_LIMIT 10000
+
+// ============================================================ //
+
 class FcmSender
 {
 
@@ -50,18 +60,46 @@ public:
     };
 
 
-    static bool startup();
+    static bool startup(uint32_t numThreads = FCM_THREADS, uint32_t queueLimit = FCM_QUEUE_LIMIT);
 
     static void cleanup();
 
+    // messages are delivered by their own executor, so blocking
+    // http requests hold neither io_service nor database threads.
+    // beyond queueLimit pending messages are dropped and counted
+
+    static bool post(const std::string &token, uint32_t type, uint32_t numElements);
 
     static bool sendMessage(const std::string &token, uint32_t type, uint32_t numElements);
 
+    // messages posted but not yet started and being delivered
+
+    static uint32_t numQueued();
+
+    static uint32_t numInflight();
+
 
     static size_t readCallback(void *ptr, size_t size, size_t nmemb, void *userp);
 
     static size_t writeCallback(void *ptr, size_t size, size_t nmemb, void *userp);
 
+protected:
+
+    static bool send(const std::string &token, uint32_t type, uint32_t numElements);
+
+protected:
+
+    static boost::shared_ptr<boost::asio::io_service> m_executor;
+
+    static boost::shared_ptr<boost::asio::io_service::work> m_executorWork;
+
+    static boost::thread_group m_executorThreads;
+
+    static uint32_t m_queueLimit;
+
+    static std::atomic<uint32_t> m_queued;
+
+    static std::atomic<uint32_t> m_inflight;
 };
 
 // ============================================================ //
@@ -0,0 +1,114 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <boost/shared_ptr.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+// ============================================================ //
+
+// every power of two is split into 2^HISTOGRAM_SUB_BUCKET_BITS
+// linear sub-buckets, values from 2^HISTOGRAM_RANGE_BITS on share
+// the last bucket
+
+#define HISTOGRAM_SUB_BUCKET_BITS 3
+
+#define HISTOGRAM_RANGE_BITS 32
+
+#define HISTOGRAM_BUCKETS (((HISTOGRAM_RANGE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) << HISTOGRAM_SUB_BUCKET_BITS) + 1)
+
+// ============================================================ //
+// Histogram
+// ============================================================ //
+
+/*
+ * Lock-free log-linear histogram in the manner of HdrHistogram.
+ * Values below 2^HISTOGRAM_SUB_BUCKET_BITS get a bucket each, every
+ * power of two above is split into as many equal sub-buckets, so
+ * the relative error stays below 1/8. Values are usually latencies
+ * in microseconds, percentiles are reported as the upper bound of
+ * the bucket they fall into.
+ */
+
+class Histogram
+{
+public:
+
+    typedef boost::shared_ptr<Histogram> Pointer;
+
+    static Pointer create();
+
+    void record(uint64_t value);
+
+    void merge(const Histogram &other);
+
+    void reset();
+
+    uint64_t count() const;
+
+    uint64_t sum() const;
+
+    uint64_t max() const;
+
+    uint64_t bucketCount(uint32_t bucket) const;
+
+    // exclusive upper bound, for the last bucket its lower bound
+
+    static uint64_t bucketBound(uint32_t bucket);
+
+    static uint32_t bucketIndex(uint64_t value);
+
+    // p is in the range [0, 1]
+
+    uint64_t percentile(double p) const;
+
+protected:
+
+    Histogram();
+
+protected:
+
+    std::atomic<uint64_t> m_buckets[HISTOGRAM_BUCKETS];
+
+    std::atomic<uint64_t> m_count;
+
+    std::atomic<uint64_t> m_sum;
+
+    std::atomic<uint64_t> m_max;
+};
+
+typedef Histogram::Pointer HISTOGRAM;
+
+// ============================================================ //
+
+#endif /* HISTOGRAM_H_ */
@@ -0,0 +1,144 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef IO_SERVICE_POOL_H_
+#define IO_SERVICE_POOL_H_
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <vector>
+
+// ============================================================ //
+// IoServicePool
+// ============================================================ //
+
+/*
+ * A set of io_service shards. In sharded mode every shard
+ * owns one io_service run by a single thread, so all handlers
+ * of a session bound to that shard execute on the same thread.
+ * In shared mode there is one shard run by several threads,
+ * which is the classic single reactor setup.
+ */
+
+class IoServicePool
+{
+public:
+
+    class Shard
+    {
+    public:
+
+        typedef boost::shared_ptr<Shard> Pointer;
+
+        static Pointer create(uint32_t index);
+
+        boost::asio::io_service &io_service();
+
+        boost::shared_ptr<boost::asio::io_service> io_service_ptr();
+
+        uint32_t index();
+
+        uint32_t load();
+
+        void acquire();
+
+        void release();
+
+    protected:
+
+        Shard(uint32_t index);
+
+    protected:
+
+        uint32_t m_index;
+
+        std::atomic<uint32_t> m_load;
+
+        boost::shared_ptr<boost::asio::io_service> m_io_service;
+
+        boost::shared_ptr<boost::asio::io_service::work> m_work;
+
+        friend class IoServicePool;
+    };
+
+    typedef Shard::Pointer SHARD;
+
+    typedef boost::shared_ptr<IoServicePool> Pointer;
+
+    enum Balance
+    {
+        RoundRobin,
+        LeastLoad
+    };
+
+    static Pointer create(uint32_t numShards, uint32_t numThreadsPerShard, Balance balance = RoundRobin);
+
+    void run();
+
+    void stop();
+
+    void join();
+
+    void release();
+
+
+    SHARD shard(uint32_t index);
+
+    SHARD select();
+
+    uint32_t size();
+
+protected:
+
+    IoServicePool(uint32_t numShards, uint32_t numThreadsPerShard, Balance balance);
+
+    static void worker(boost::shared_ptr<boost::asio::io_service> io_service);
+
+protected:
+
+    uint32_t m_numThreadsPerShard;
+
+    Balance m_balance;
+
+    std::atomic<uint32_t> m_next;
+
+    std::vector<SHARD> m_shards;
+
+    boost::thread_group m_threads;
+};
+
+typedef IoServicePool::Pointer IO_SERVICE_POOL;
+
+typedef IoServicePool::SHARD IO_SERVICE_SHARD;
+
+// ============================================================ //
+
+#endif /* IO_SERVICE_POOL_H_ */
@@ -0,0 +1,147 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef LOCK_PROFILER_H_
+#define LOCK_PROFILER_H_
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+// ============================================================ //
+
+// seconds between two lock profile reports in the log
+
+#define LOCK_PROFILE_INTERVAL 60
+
+// ============================================================ //
+// LockProfiler
+// ============================================================ //
+
+/*
+ * Registry of the lock sites seen while built with
+ * ZWAY_LOCK_PROFILING. Mutexes with the same name share one
+ * site, so e.g. the status locks of all sessions are reported
+ * together. Times are in nanoseconds.
+ */
+
+class LockProfiler
+{
+public:
+
+    struct Site
+    {
+        Site(const std::string &name);
+
+        std::string name;
+
+        std::atomic<uint64_t> acquisitions;
+
+        std::atomic<uint64_t> contended;
+
+        std::atomic<uint64_t> waitTime;
+
+        std::atomic<uint64_t> holdTime;
+
+        std::atomic<uint64_t> maxWait;
+
+        std::atomic<uint64_t> maxHold;
+    };
+
+    struct Stats
+    {
+        std::string name;
+
+        uint64_t acquisitions;
+
+        uint64_t contended;
+
+        uint64_t waitTime;
+
+        uint64_t holdTime;
+
+        uint64_t maxWait;
+
+        uint64_t maxHold;
+    };
+
+    static Site *site(const char *name);
+
+    // sorted by total wait time, most contended first
+
+    static std::vector<Stats> stats();
+
+    static std::string report();
+
+    static uint64_t now();
+
+protected:
+
+    static boost::mutex m_mutex;
+
+    static std::map<std::string, boost::shared_ptr<Site>> m_sites;
+};
+
+// ============================================================ //
+// ProfiledMutex
+// ============================================================ //
+
+class ProfiledMutex : boost::noncopyable
+{
+public:
+
+    typedef boost::unique_lock<ProfiledMutex> scoped_lock;
+
+    ProfiledMutex(const char *name = "unnamed");
+
+    void lock();
+
+    bool try_lock();
+
+    void unlock();
+
+protected:
+
+    boost::mutex m_mutex;
+
+    LockProfiler::Site *m_site;
+
+    // written by the owner only
+
+    uint64_t m_lockedAt;
+};
+
+// ============================================================ //
+
+#endif /* LOCK_PROFILER_H_ */
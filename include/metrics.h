@@ -0,0 +1,107 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include "histogram.h"
+#include "thread.h"
+
+#include <atomic>
+
+// ============================================================ //
+// Metrics
+// ============================================================ //
+
+/*
+ * Process wide counters and latency histograms. Updates go to a
+ * block owned by the calling thread, so the I/O path never shares
+ * a cache line with other threads or the exporter. Reads merge all
+ * blocks, including those of threads that have exited.
+ */
+
+class Metrics
+{
+public:
+
+    enum Counter
+    {
+        BytesIn = 0,
+        BytesOut,
+        PacketsIn,
+        PacketsOut,
+        Writes,
+        DbQueries,
+        DbTimeouts,
+        DbOpened,
+        DbClosed,
+        FcmSent,
+        FcmFailed,
+        FcmDropped,
+        AccountCacheHits,
+        AccountCacheMisses,
+        NumCounters
+    };
+
+    // timers are recorded in microseconds
+
+    enum Timer
+    {
+        DbWait = 0,
+        FcmSend,
+        ControlLaneDelay,
+        BulkLaneDelay,
+        NumTimers
+    };
+
+    static void add(Counter counter, uint64_t value = 1);
+
+    static void observe(Timer timer, uint64_t value);
+
+    static uint64_t counter(Counter counter);
+
+    static HISTOGRAM timer(Timer timer);
+
+protected:
+
+    struct Block
+    {
+        Block();
+
+        std::atomic<uint64_t> counters[NumCounters];
+
+        HISTOGRAM timers[NumTimers];
+    };
+
+    typedef PerThread<Block> Blocks;
+};
+
+// ============================================================ //
+
+#endif /* METRICS_H_ */
@@ -0,0 +1,163 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef METRICS_EXPORTER_H_
+#define METRICS_EXPORTER_H_
+
+#include "histogram.h"
+
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+// ============================================================ //
+
+#define METRICS_PORT 5558
+
+#define METRICS_MAX_REQUEST 4096
+
+#define METRICS_TIMEOUT 5000
+
+// ============================================================ //
+// MetricsExporter
+// ============================================================ //
+
+/*
+ * Minimal HTTP/1.0 endpoint for scrapers. Every connection
+ * serves a single GET request, the response body is produced
+ * by the handler registered for the request path and gets the
+ * query string as argument. Meant to listen on a local address.
+ * The exporter runs its own io_service on a dedicated thread, so
+ * scrapes never delay session I/O, and connections are closed
+ * after METRICS_TIMEOUT milliseconds.
+ */
+
+class MetricsExporter : public boost::enable_shared_from_this<MetricsExporter>
+{
+public:
+
+    typedef boost::shared_ptr<MetricsExporter> Pointer;
+
+    typedef boost::function<std::string (const std::string &query)> Handler;
+
+    static Pointer create();
+
+    void addHandler(const std::string &path, const Handler &handler);
+
+    bool start(const std::string &address, uint16_t port);
+
+    void stop();
+
+
+    // text exposition format helpers, histograms are
+    // expected in microseconds and written in seconds.
+    // integers are written exactly, reals with 17 digits
+
+    static void writeHeader(std::ostream &os, const std::string &name, const std::string &type, const std::string &help);
+
+    static void writeValue(std::ostream &os, const std::string &name, const std::string &labels, double value);
+
+    static void writeValue(std::ostream &os, const std::string &name, const std::string &labels, uint64_t value);
+
+    template <class T>
+    static typename std::enable_if<std::is_integral<T>::value>::type
+    writeValue(std::ostream &os, const std::string &name, const std::string &labels, T value)
+    {
+        writeValue(os, name, labels, static_cast<uint64_t>(value));
+    }
+
+    static void writeHistogram(std::ostream &os, const std::string &name, const std::string &labels, const Histogram &histogram);
+
+protected:
+
+    class Connection : public boost::enable_shared_from_this<Connection>
+    {
+    public:
+
+        typedef boost::shared_ptr<Connection> Pointer;
+
+        Connection(boost::asio::io_service &io_service, MetricsExporter::Pointer exporter);
+
+        void start();
+
+        boost::asio::ip::tcp::socket &socket();
+
+    protected:
+
+        void onTimeout(const boost::system::error_code &error);
+
+        void onRead(const boost::system::error_code &error, size_t bytes_transferred);
+
+        void onWritten(const boost::system::error_code &error, size_t bytes_transferred);
+
+        void respond(const std::string &status, const std::string &body);
+
+    protected:
+
+        MetricsExporter::Pointer m_exporter;
+
+        boost::asio::ip::tcp::socket m_socket;
+
+        boost::asio::deadline_timer m_timer;
+
+        boost::asio::streambuf m_request;
+
+        std::string m_response;
+    };
+
+    MetricsExporter();
+
+    void accept();
+
+    void onAccept(const boost::system::error_code &error, Connection::Pointer connection);
+
+protected:
+
+    boost::asio::io_service m_io_service;
+
+    boost::shared_ptr<boost::asio::io_service::work> m_work;
+
+    boost::thread m_thread;
+
+    boost::asio::ip::tcp::acceptor m_acceptor;
+
+    std::map<std::string, Handler> m_handlers;
+};
+
+typedef MetricsExporter::Pointer METRICS_EXPORTER;
+
+// ============================================================ //
+
+#endif /* METRICS_EXPORTER_H_ */
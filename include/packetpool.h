@@ -0,0 +1,179 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef PACKET_POOL_H_
+#define PACKET_POOL_H_
+
+#include "Zway/core/packet.h"
+#include "thread.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include <atomic>
+#include <map>
+#include <vector>
+
+// ============================================================ //
+
+#define PACKET_POOL_MAX_PACKETS 1024
+
+#define PACKET_POOL_MAX_BUFFERS 64
+
+#define PACKET_POOL_MAX_CLASSES 32
+
+#define PACKET_POOL_MAX_BYTES (1024 * 1024)
+
+// ============================================================ //
+// PacketPool
+// ============================================================ //
+
+/*
+ * Per-thread free lists for packets and body buffers of the
+ * session I/O path. Objects handed out return to the pool of
+ * the thread that created them as soon as their last reference
+ * drops. Body buffers are pooled per exact size, since the size
+ * of a Zway::Buffer is fixed and used as the payload length. The
+ * buffers kept by one thread are limited to PACKET_POOL_MAX_BYTES,
+ * the least recently used size classes are evicted to stay below.
+ */
+
+class PacketPool : public boost::enable_shared_from_this<PacketPool>
+{
+public:
+
+    typedef boost::shared_ptr<PacketPool> Pointer;
+
+    struct Stats
+    {
+        Stats();
+
+        uint64_t hits;
+
+        uint64_t misses;
+
+        uint64_t inUse;
+
+        uint64_t highWater;
+    };
+
+    // the packet head is left as is, callers overwrite it
+
+    static Zway::PACKET createPacket();
+
+    // the buffer content is undefined, callers overwrite it
+
+    static Zway::BUFFER createBuffer(size_t size);
+
+    static Stats packetStats();
+
+    static Stats bufferStats();
+
+protected:
+
+    struct Counters
+    {
+        Counters();
+
+        void acquire(bool hit);
+
+        void release();
+
+        void merge(Stats &stats);
+
+        std::atomic<uint64_t> hits;
+
+        std::atomic<uint64_t> misses;
+
+        std::atomic<uint64_t> inUse;
+
+        std::atomic<uint64_t> highWater;
+    };
+
+    template <class T>
+    struct Recycler
+    {
+        Recycler(Pointer pool, const std::shared_ptr<T> &obj)
+            : pool(pool), obj(obj)
+        {
+        }
+
+        void operator()(T*)
+        {
+            pool->recycle(obj);
+        }
+
+        Pointer pool;
+
+        std::shared_ptr<T> obj;
+    };
+
+    PacketPool();
+
+    Zway::PACKET acquirePacket();
+
+    Zway::BUFFER acquireBuffer(size_t size);
+
+    void recycle(const Zway::PACKET &pkt);
+
+    void recycle(const Zway::BUFFER &buf);
+
+    bool evictBuffers(size_t keep);
+
+protected:
+
+    struct BufferClass
+    {
+        std::vector<Zway::BUFFER> buffers;
+
+        uint64_t lastUse;
+    };
+
+    boost::mutex m_mutex;
+
+    std::vector<Zway::PACKET> m_packets;
+
+    std::map<size_t, BufferClass> m_buffers;
+
+    size_t m_bufferBytes;
+
+    uint64_t m_bufferClock;
+
+    Counters m_packetCounters;
+
+    Counters m_bufferCounters;
+
+    typedef PerThread<PacketPool> Pools;
+
+    friend class PerThread<PacketPool>;
+};
+
+// ============================================================ //
+
+#endif /* PACKET_POOL_H_ */
@@ -0,0 +1,152 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef PRESENCE_H_
+#define PRESENCE_H_
+
+#include "session.h"
+#include "sharded.h"
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include <map>
+#include <set>
+#include <vector>
+
+// ============================================================ //
+
+#define PRESENCE_SHARDS 64
+
+// ============================================================ //
+// Presence
+// ============================================================ //
+
+/*
+ * Online status of accounts and a reverse index from each account
+ * to the sessions that watch it. An account is online while one of
+ * its sessions has notifyStatus set. Its audience is the set of
+ * contacts it shares its status with, watchers outside of it are
+ * skipped when visiting. Visitors must not call back into Presence.
+ */
+
+class Presence
+{
+public:
+
+    Presence();
+
+    // logged in sessions per account, the entry
+    // is dropped with the last session and watcher
+
+    void attach(uint32_t accountId);
+
+    void detach(uint32_t accountId);
+
+    // returns true if the status of the account changed
+
+    bool setVisible(uint32_t accountId, bool visible);
+
+    void setAudience(uint32_t accountId, const std::set<uint32_t> &audience);
+
+    void addAudience(uint32_t accountId, uint32_t contactId);
+
+    void subscribe(const CLIENT_SESSION &session, const std::set<uint32_t> &accountIds);
+
+    // same with the watcher's account id given, the session is only stored
+
+    void subscribe(const CLIENT_SESSION &session, uint32_t watcherId, const std::set<uint32_t> &accountIds);
+
+    void unsubscribe(const CLIENT_SESSION &session, const std::set<uint32_t> &accountIds);
+
+    uint32_t status(uint32_t accountId);
+
+    // bulk lookup, locks every shard at most once
+
+    std::vector<uint32_t> status(const std::vector<uint32_t> &accountIds);
+
+    template <class Visitor>
+    size_t visitWatchers(uint32_t accountId, Visitor visitor)
+    {
+        Shard &s = m_shards.shard(accountId);
+
+        boost::shared_lock<boost::shared_mutex> locker(s.mutex);
+
+        auto it = s.map.find(accountId);
+
+        if (it == s.map.end()) {
+
+            return 0;
+        }
+
+        size_t res = 0;
+
+        for (auto &w : it->second.watchers) {
+
+            if (it->second.audience.count(w.second)) {
+
+                visitor(w.first);
+
+                res++;
+            }
+        }
+
+        return res;
+    }
+
+protected:
+
+    struct Entry
+    {
+        Entry();
+
+        uint32_t sessions;
+
+        uint32_t visible;
+
+        std::set<uint32_t> audience;
+
+        // watching sessions and their account ids
+
+        std::map<CLIENT_SESSION, uint32_t> watchers;
+    };
+
+    typedef MapShard<Entry, boost::shared_mutex> Shard;
+
+    typedef Sharded<Shard, PRESENCE_SHARDS> Shards;
+
+    void release(Shard &s, Shard::Map::iterator it);
+
+protected:
+
+    Shards m_shards;
+};
+
+// ============================================================ //
+
+#endif /* PRESENCE_H_ */
@@ -0,0 +1,89 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef REQUEST_COUNTERS_H_
+#define REQUEST_COUNTERS_H_
+
+#include "sharded.h"
+
+// ============================================================ //
+
+#define REQUEST_COUNTERS_SHARDS 64
+
+// ============================================================ //
+// RequestCounters
+// ============================================================ //
+
+/*
+ * Pending contact and push requests per destination account, the
+ * numbers sent with offline notifications. DB::addRequest and
+ * DB::deleteRequest keep them in step with zway.requests, load
+ * replaces them with counts taken from the collection at startup.
+ * Other request types are not counted.
+ */
+
+class RequestCounters
+{
+public:
+
+    struct Counts
+    {
+        Counts();
+
+        uint32_t contactRequests;
+
+        uint32_t pushRequests;
+    };
+
+    typedef std::unordered_map<uint32_t, Counts> Map;
+
+    static void add(uint32_t accountId, uint32_t type);
+
+    static void remove(uint32_t accountId, uint32_t type);
+
+    static Counts get(uint32_t accountId);
+
+    static void load(const Map &counts);
+
+protected:
+
+    typedef MapShard<Counts> Shard;
+
+    typedef Sharded<Shard, REQUEST_COUNTERS_SHARDS> Shards;
+
+    static uint32_t *counter(Counts &counts, uint32_t type);
+
+protected:
+
+    static Shards m_shards;
+};
+
+// ============================================================ //
+
+#endif /* REQUEST_COUNTERS_H_ */
@@ -0,0 +1,131 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef REQUEST_DISPATCHER_H_
+#define REQUEST_DISPATCHER_H_
+
+#include "histogram.h"
+#include "thread.h"
+
+#include <Zway/core/ubj/value.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+// ============================================================ //
+
+#define REQUEST_DISPATCHER_MAX_TYPES 32
+
+// ============================================================ //
+// RequestDispatcher
+// ============================================================ //
+
+/*
+ * Maps request types to session handlers and keeps latency and
+ * success/failure statistics per type. Latency is measured from
+ * dispatch to the response, so asynchronous handlers are covered
+ * as well. Statistics are recorded into per-thread blocks without
+ * locking and merged when read. Handlers are registered at startup,
+ * before any session runs.
+ */
+
+class ClientSession;
+
+class RequestDispatcher
+{
+public:
+
+    typedef bool (ClientSession::*Handler)(const Zway::UBJ::Object &request);
+
+    struct Stats
+    {
+        Stats();
+
+        uint32_t type;
+
+        std::string name;
+
+        uint64_t success;
+
+        uint64_t failure;
+
+        // latency in microseconds
+
+        HISTOGRAM latency;
+    };
+
+    static bool add(uint32_t type, const std::string &name, Handler handler);
+
+    static bool has(uint32_t type);
+
+    static bool dispatch(ClientSession *session, uint32_t type, const Zway::UBJ::Object &request);
+
+    static void record(uint32_t type, uint64_t latency, bool success);
+
+    static std::vector<Stats> stats();
+
+protected:
+
+    struct Entry
+    {
+        uint32_t slot;
+
+        std::string name;
+
+        Handler handler;
+    };
+
+    struct Counters
+    {
+        Counters();
+
+        std::atomic<uint64_t> success;
+
+        std::atomic<uint64_t> failure;
+
+        HISTOGRAM latency;
+    };
+
+    struct ThreadStats
+    {
+        Counters counters[REQUEST_DISPATCHER_MAX_TYPES];
+    };
+
+    typedef PerThread<ThreadStats> Blocks;
+
+protected:
+
+    static std::map<uint32_t, Entry> m_handlers;
+};
+
+// ============================================================ //
+
+#endif /* REQUEST_DISPATCHER_H_ */
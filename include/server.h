@@ -31,12 +31,28 @@
 #define SERVER_H_
 
 #include "db.h"
+#include "accountcache.h"
 #include "session.h"
+#include "sessionregistry.h"
+#include "statussnapshot.h"
+#include "presence.h"
 #include "fcmsender.h"
+#include "histogram.h"
+#include "ioservicepool.h"
+#include "metricsexporter.h"
+#include "tlssessioncache.h"
 #include "streambuffersender.h"
 
 #include <boost/thread.hpp>
 
+// ============================================================ //
+
+#define NUM_ACCEPTORS 1
+
+#define NUM_PENDING_ACCEPTS 4
+
+#define ACCEPT_RETRY_DELAY 100
+
 // ============================================================ //
 // Server
 // ============================================================ //
@@ -45,9 +61,74 @@ class Server
 {
     public:
 
-        Server(boost::shared_ptr<boost::asio::io_service> io_service);
+        struct Options
+        {
+            Options();
+
+            // number of SO_REUSEPORT acceptors, each one
+            // bound to its own shard
+
+            uint32_t numAcceptors;
+
+            // number of async_accept operations kept
+            // outstanding per acceptor
+
+            uint32_t pendingAccepts;
+
+            // upper bounds for the packets coalesced
+            // into a single session write
+
+            uint32_t sendBatchBytes;
+
+            uint32_t sendBatchPackets;
+
+            // per-session outbound queue limits in bytes
+
+            uint32_t sendQueueLowWatermark;
+
+            uint32_t sendQueueHighWatermark;
+
+            uint32_t sendQueueHardLimit;
+
+            // minimum percentage of batch bytes for the bulk lane
+
+            uint32_t bulkShare;
+
+            // tls session cache entries and
+            // session ticket key lifetime in seconds
+
+            uint32_t tlsCacheSize;
+
+            uint32_t tlsTicketLifetime;
+
+            // database pool bounds, acquire timeout in milliseconds
+            // and idle timeout in seconds, see DB::PoolOptions
+
+            uint32_t dbMinConnections;
+
+            uint32_t dbMaxConnections;
+
+            uint32_t dbAcquireTimeout;
+
+            uint32_t dbIdleTimeout;
+
+            // account cache entries, 0 disables it,
+            // and entry lifetime in seconds
+
+            uint32_t accountCacheSize;
+
+            uint32_t accountCacheTtl;
+
+            // port of the metrics endpoint on 127.0.0.1, 0 disables it
 
-        bool start(const std::string &workingDir, const std::string& address, uint32_t port);
+            uint32_t metricsPort;
+        };
+
+        typedef boost::shared_ptr<boost::asio::ip::tcp::acceptor> ACCEPTOR;
+
+        Server(IO_SERVICE_POOL ioPool);
+
+        bool start(const std::string &workingDir, const std::string& address, uint32_t port, const Options &options = Options());
 
         void close();
 
@@ -64,11 +145,23 @@ class Server
 
         size_t getSessionCount();
 
-        CLIENT_SESSION_LIST getSessions(uint32_t userId);
+        Presence &presence();
+
+        // visits the sessions of a user in place, see SessionRegistry
+
+        template <class Visitor>
+        size_t visitSessions(uint32_t userId, Visitor visitor)
+        {
+            return m_sessions.visit(userId, visitor);
+        }
 
 
         void processUserRequests(uint32_t userId);
 
+        // notifications for the offline ones share one db job
+
+        void processUsersRequests(const std::vector<uint32_t> &userIds);
+
 
         bool addStreamBuffer(STREAM_BUFFER buffer);
 
@@ -79,52 +172,103 @@ class Server
 
         void addStreamBufferSender(STREAM_BUFFER_SENDER sender);
 
+        void removeStreamBufferSender(StreamBufferSender *sender);
+
+        // drops the senders of an expired stream buffer
+        // or of a closed session, they keep the session alive
+
+        void removeStreamBufferSenders(uint32_t id);
+
+        void removeStreamBufferSenders(ClientSession *session);
+
+        void notifyStreamBufferSenders(uint32_t id);
+
 
         size_t numStreamBuffers();
 
 
-        void info();
+        // never queries the database, safe to call from any thread
+
+        STATUS_SNAPSHOT snapshot();
+
+        void info(uint32_t offset = 0, uint32_t limit = STATUS_PAGE_SIZE);
+
+        // counters, gauges and histograms in the prometheus text format
+
+        std::string metrics();
 
         bool paused() const;
 
         boost::shared_ptr<boost::asio::io_service> io_service();
 
+        IO_SERVICE_POOL ioServicePool();
+
+        TIMER_WHEEL timerWheel(uint32_t shard);
+
+        HISTOGRAM laneLatency(uint32_t lane);
+
+        const Options &options() const;
+
     private:
 
         void onTimer(const boost::system::error_code &error);
 
         std::string uptimeStr();
 
-        void accept();
+        bool listen();
+
+        void closeAcceptors();
+
+        void accept(ACCEPTOR acceptor, IO_SERVICE_SHARD shard);
+
+        void retryAccept(ACCEPTOR acceptor, IO_SERVICE_SHARD shard);
 
         void handleSession(
                 const boost::system::error_code& error,
+                ACCEPTOR acceptor,
+                IO_SERVICE_SHARD shard,
                 CLIENT_SESSION session);
     private:
 
+        Options m_options;
+
         bool m_paused;
 
-        uint32_t m_numSessions;
+        std::atomic<uint32_t> m_numSessions;
+
+        IO_SERVICE_POOL m_ioPool;
 
         boost::shared_ptr<boost::asio::io_service> m_io_service;
 
         boost::asio::deadline_timer m_timer;
 
+        std::vector<TIMER_WHEEL> m_timerWheels;
+
         boost::posix_time::ptime m_startTime;
 
+#ifdef ZWAY_LOCK_PROFILING
+        boost::posix_time::ptime m_lockReportTime;
+#endif
+
         boost::asio::ssl::context m_context;
 
-        boost::asio::ip::tcp::acceptor m_acceptor;
+        std::vector<ACCEPTOR> m_acceptors;
+
+        METRICS_EXPORTER m_metricsExporter;
 
         boost::asio::ip::tcp::socket::endpoint_type m_endpoint;
 
-        ThreadSafe<CLIENT_SESSION_MAP> m_sessions;
+        SessionRegistry m_sessions;
+
+        Presence m_presence;
 
         // TODO cleanup mechanism for buffers
 
         ThreadSafe<std::map<uint32_t, STREAM_BUFFER>> m_buffers;
 
-        ThreadSafe<std::list<STREAM_BUFFER_SENDER>> m_senders;
+        // senders waiting for stream buffer data, by stream id
+
+        ThreadSafe<std::map<uint32_t, std::list<STREAM_BUFFER_SENDER>>> m_senders;
 };
 
 // ============================================================ //
@@ -31,6 +31,8 @@
 #define SESSION_H_
 
 #include "thread.h"
+#include "ioservicepool.h"
+#include "timerwheel.h"
 #include "streambuffer.h"
 
 #include "Zway/core/engine.h"
@@ -38,8 +40,11 @@
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
 
+#include <atomic>
 #include <queue>
+#include <set>
 
 // ============================================================ //
 
@@ -47,6 +52,22 @@
 
 #define HEARTBEAT_TIMEOUT 40000
 
+#define SEND_BATCH_BYTES (64 * 1024)
+
+#define SEND_BATCH_PACKETS 64
+
+#define RECV_BUFFER_SIZE (64 * 1024)
+
+#define SEND_QUEUE_LOW_WATERMARK (128 * 1024)
+
+#define SEND_QUEUE_HIGH_WATERMARK (512 * 1024)
+
+#define SEND_QUEUE_HARD_LIMIT (16 * 1024 * 1024)
+
+#define SLOW_CONSUMER_TIMEOUT 30000
+
+#define BULK_MIN_SHARE 25
+
 // ============================================================ //
 
 #define STATUS_DISCONNECTED         0
@@ -64,13 +85,24 @@ class Server;
 
 class ClientSession
     : public Zway::Engine,
+      public TimerWheel::Entry,
       public boost::enable_shared_from_this<ClientSession>
 {
 public:
 
     typedef boost::shared_ptr<ClientSession> Pointer;
 
-    static Pointer create(Server *server, boost::asio::io_service& io_service, boost::asio::ssl::context& context);
+    // outbound lanes, resource streams go to the bulk lane
+
+    enum Lane {
+        ControlLane = 0,
+        BulkLane,
+        NumLanes
+    };
+
+    static Pointer create(Server *server, IO_SERVICE_SHARD shard, boost::asio::ssl::context& context);
+
+    ~ClientSession();
 
     void start();
 
@@ -79,12 +111,31 @@ public:
 
     uint32_t status();
 
+    uint32_t numPacketsSent();
+
+    uint32_t numWritesSent();
+
+    uint32_t queuedPackets();
+
+    uint64_t queuedBytes();
+
     std::string remoteHost();
 
     uint32_t accountId();
 
+    // cached at login, for status output
+
+    std::string accountName();
+
     ssl_socket::lowest_layer_type& socket();
 
+    IO_SERVICE_SHARD shard();
+
+    void execute(const boost::function<void ()> &handler);
+
+
+    static void registerRequestHandlers();
+
 
     static void ubjValToBson(const std::string &key, const Zway::UBJ::Value &val, mongo::BSONObjBuilder &ob);
 
@@ -100,7 +151,7 @@ public:
 
 protected:
 
-    ClientSession(Server *server, boost::asio::io_service &io_service, boost::asio::ssl::context &context);
+    ClientSession(Server *server, IO_SERVICE_SHARD shard, boost::asio::ssl::context &context);
 
 
     void setStatus(uint32_t status);
@@ -108,11 +159,13 @@ protected:
     bool setConfig(const Zway::UBJ::Object &config);
 
 
-    void onTimer(const boost::system::error_code &error);
+    void onTimeout();
+
+    void onDeadline();
 
-    void resetTimer();
+    void onHeartbeatTimeout();
 
-    void pauseTimer();
+    void touch();
 
 
     void handleHandshake(const boost::system::error_code &error);
@@ -120,14 +173,13 @@ protected:
     void onPacketSent(
             const boost::system::error_code &error,
             size_t bytes_transferred,
-            Zway::PACKET pkt);
+            uint32_t numPackets);
 
     void onPacketRecv(Zway::PACKET pkt);
 
     void onPacketHeadRecv(
             const boost::system::error_code &error,
-            size_t bytes_transferred,
-            Zway::PACKET pkt);
+            size_t bytes_transferred);
 
     void onPacketBodyRecv(
             const boost::system::error_code &error,
@@ -138,13 +190,23 @@ protected:
 
     bool sendPacket();
 
+    void pollStreamSenders();
+
+    void enqueuePacket(Zway::PACKET pkt);
+
+    Zway::PACKET dequeuePacket(Lane lane);
+
+    void onSlowConsumer();
+
     bool recvPacket();
 
-    void recvPacketBody(Zway::PACKET pkt);
+    void recvPacketBody(Zway::PACKET pkt, size_t offset);
 
 
     bool processRequests();
 
+    void handleRequests(const std::list<mongo::BSONObj> &requests);
+
 
     bool processDispatchRequest(const Zway::UBJ::Object &head);
 
@@ -172,10 +234,35 @@ protected:
     bool processPushRequest(const Zway::UBJ::Object &head);
 
 
-    void broadcastStatus(uint32_t status, bool check = true);
+    void broadcastStatus(uint32_t status);
 
     uint32_t getContactStatus(uint32_t contactId);
 
+    Zway::UBJ::Array getContactStatus();
+
+    void addContact(uint32_t contactId);
+
+    void leavePresence();
+
+    void deleteStoredRequest(uint32_t requestId);
+
+    // request handlers running as coroutines, see Task
+
+    class LoginTask;
+
+    class AddContactTask;
+
+    class AcceptContactTask;
+
+
+    // runs query on the db executor and handler on the strand,
+    // the handler is dropped if the session closed meanwhile
+
+    template <class Result>
+    void dbQuery(
+            const boost::function<Result ()> &query,
+            const boost::function<void (const Result&)> &handler);
+
 
     bool postPacket(Zway::PACKET pkt);
 
@@ -184,6 +271,14 @@ protected:
 
     bool processIncomingRequest(const Zway::UBJ::Object &request);
 
+    void finishRequest(uint32_t requestId, bool success);
+
+    // responses also complete the timing of their request
+
+    bool postRequestSuccess(uint32_t requestId, const Zway::UBJ::Object &response = Zway::UBJ::Object());
+
+    bool postRequestFailure(uint32_t requestId, uint32_t errorCode, const std::string &errorMessage);
+
     Zway::STREAM_RECEIVER createStreamReceiver(const Zway::Packet &pkt);
 
     Zway::UBJ::Object &config();
@@ -196,29 +291,98 @@ private:
 
     Server* m_server;
 
+    IO_SERVICE_SHARD m_shard;
+
+    // counted in the shard load from start on, sessions waiting
+    // in a pending accept are no connections yet
+
+    bool m_started;
+
     ssl_socket m_socket;
 
-    boost::asio::deadline_timer m_timer;
+    // every handler of this session runs through the strand, so
+    // members not marked ThreadSafe are owned by it exclusively
+
+    boost::asio::io_service::strand m_strand;
+
+    TIMER_WHEEL m_timerWheel;
+
+    Atomic<uint32_t> m_status;
+
+    // read by the status snapshot from other threads
 
-    ThreadSafe<uint32_t> m_status;
+    ThreadSafe<std::string> m_remoteHost;
 
-    std::string m_remoteHost;
+    Atomic<uint32_t> m_accountId;
 
-    uint32_t m_accountId;
+    ThreadSafe<std::string> m_accountName;
 
-    uint32_t m_numPacketsSent;
+    std::atomic<uint32_t> m_numPacketsSent;
+
+    std::atomic<uint32_t> m_numWritesSent;
 
     uint32_t m_numPacketsRecv;
 
-    ThreadSafe<bool> m_sending;
+    bool m_sending;
+
+    std::vector<uint8_t> m_sendBuffer;
+
+    // received bytes not yet parsed are kept in
+    // m_recvBuffer between m_recvBegin and m_recvEnd
+
+    std::vector<uint8_t> m_recvBuffer;
 
-    ThreadSafe<std::queue<Zway::PACKET>> m_packetQueue;
+    size_t m_recvBegin;
+
+    size_t m_recvEnd;
+
+    struct QueuedPacket
+    {
+        Zway::PACKET pkt;
+
+        uint64_t time;
+    };
+
+    std::queue<QueuedPacket> m_lanes[NumLanes];
+
+    // outbound queue accounting, stream senders are not polled while
+    // the queued bytes of both lanes are between the high and low watermark
+
+    uint64_t m_laneBytes[NumLanes];
+
+    std::atomic<uint32_t> m_queuedPackets;
+
+    std::atomic<uint64_t> m_queuedBytes;
+
+    bool m_sendersPaused;
+
+    uint64_t m_overLimitSince;
 
     ThreadSafe<std::map<uint32_t, Zway::UBJ::Object>> m_contacts;
 
     Zway::UBJ::Object m_config;
 
+    struct PendingRequest
+    {
+        uint32_t type;
+
+        uint64_t time;
+    };
+
+    std::map<uint32_t, PendingRequest> m_pendingRequests;
+
+    // presence state, owned by the strand
+
+    bool m_presenceAttached;
+
+    bool m_presenceVisible;
+
+    std::set<uint32_t> m_watching;
+
     friend class Server;
+
+    template <class T>
+    friend class Task;
 };
 
 typedef ClientSession::Pointer CLIENT_SESSION;
@@ -0,0 +1,124 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef SESSION_REGISTRY_H_
+#define SESSION_REGISTRY_H_
+
+#include "session.h"
+#include "sharded.h"
+
+#include <boost/thread/shared_mutex.hpp>
+
+// ============================================================ //
+
+#define SESSION_REGISTRY_SHARDS 64
+
+// ============================================================ //
+// SessionRegistry
+// ============================================================ //
+
+/*
+ * Online sessions keyed by account id, split into shards with
+ * their own reader-writer lock. Lookups visit the sessions of an
+ * account in place under the shard's shared lock, so they neither
+ * copy lists nor touch reference counts. Visitors must not call
+ * back into the registry.
+ */
+
+class SessionRegistry
+{
+public:
+
+    SessionRegistry();
+
+    void append(const CLIENT_SESSION &session);
+
+    // same with the account id given, the session is only stored
+
+    void append(uint32_t accountId, const CLIENT_SESSION &session);
+
+    void remove(const CLIENT_SESSION &session);
+
+    CLIENT_SESSION_LIST removeAll();
+
+    size_t size();
+
+    template <class Visitor>
+    size_t visit(uint32_t accountId, Visitor visitor)
+    {
+        Shard &s = m_shards.shard(accountId);
+
+        boost::shared_lock<boost::shared_mutex> locker(s.mutex);
+
+        auto it = s.map.find(accountId);
+
+        if (it == s.map.end()) {
+
+            return 0;
+        }
+
+        for (const CLIENT_SESSION &session : it->second) {
+
+            visitor(session);
+        }
+
+        return it->second.size();
+    }
+
+    template <class Visitor>
+    void visitAll(Visitor visitor)
+    {
+        for (Shard &s : m_shards) {
+
+            boost::shared_lock<boost::shared_mutex> locker(s.mutex);
+
+            for (auto &it : s.map) {
+
+                for (const CLIENT_SESSION &session : it.second) {
+
+                    visitor(session);
+                }
+            }
+        }
+    }
+
+protected:
+
+    typedef MapShard<CLIENT_SESSION_LIST, boost::shared_mutex> Shard;
+
+    typedef Sharded<Shard, SESSION_REGISTRY_SHARDS> Shards;
+
+protected:
+
+    Shards m_shards;
+};
+
+// ============================================================ //
+
+#endif /* SESSION_REGISTRY_H_ */
@@ -0,0 +1,98 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef SHARDED_H_
+#define SHARDED_H_
+
+#include <boost/thread/mutex.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+
+// ============================================================ //
+// Sharded
+// ============================================================ //
+
+/*
+ * Fixed set of shards selected by account id, for state that is
+ * updated from many threads. Every shard carries its own lock,
+ * callers lock the shard they touch and never more than one at
+ * a time, except for whole-set walks.
+ */
+
+template <class Shard, uint32_t NumShards>
+class Sharded
+{
+public:
+
+    static uint32_t index(uint32_t accountId)
+    {
+        return accountId % NumShards;
+    }
+
+    Shard &shard(uint32_t accountId)
+    {
+        return m_shards[index(accountId)];
+    }
+
+    Shard *begin()
+    {
+        return m_shards;
+    }
+
+    Shard *end()
+    {
+        return m_shards + NumShards;
+    }
+
+protected:
+
+    Shard m_shards[NumShards];
+};
+
+// ============================================================ //
+// MapShard
+// ============================================================ //
+
+// shard of a map keyed by account id, Mutex is boost::mutex
+// or boost::shared_mutex for read-mostly maps
+
+template <class Value, class Mutex = boost::mutex>
+struct MapShard
+{
+    typedef std::unordered_map<uint32_t, Value> Map;
+
+    Mutex mutex;
+
+    Map map;
+};
+
+// ============================================================ //
+
+#endif /* SHARDED_H_ */
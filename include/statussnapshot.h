@@ -0,0 +1,102 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef STATUS_SNAPSHOT_H_
+#define STATUS_SNAPSHOT_H_
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ============================================================ //
+
+#define STATUS_PAGE_SIZE 100
+
+// ============================================================ //
+// StatusSnapshot
+// ============================================================ //
+
+/*
+ * Point in time copy of the server state. It is filled from
+ * values the sessions already cache, registry locks are only
+ * held while the session list is copied and no database query
+ * is made, so taking one never stalls the I/O path.
+ */
+
+class StatusSnapshot
+{
+public:
+
+    typedef boost::shared_ptr<StatusSnapshot> Pointer;
+
+    struct Session
+    {
+        std::string remoteHost;
+
+        uint32_t accountId;
+
+        std::string accountName;
+
+        uint32_t numPacketsSent;
+
+        uint32_t numWritesSent;
+
+        uint32_t queuedPackets;
+
+        uint64_t queuedBytes;
+    };
+
+    static Pointer create();
+
+    // summary followed by the sessions in [offset, offset + limit)
+
+    std::string format(uint32_t offset = 0, uint32_t limit = STATUS_PAGE_SIZE) const;
+
+    // parses "offset=..&limit=.." as passed to the status endpoint
+
+    std::string format(const std::string &query) const;
+
+public:
+
+    std::string summary;
+
+    std::vector<Session> sessions;
+
+protected:
+
+    StatusSnapshot();
+};
+
+typedef StatusSnapshot::Pointer STATUS_SNAPSHOT;
+
+// ============================================================ //
+
+#endif /* STATUS_SNAPSHOT_H_ */
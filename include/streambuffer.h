@@ -33,6 +33,8 @@
 #include "Zway/core/packet.h"
 #include "thread.h"
 
+#include <functional>
+
 // ============================================================ //
 
 class FileBuffer : public Zway::Buffer
@@ -77,6 +79,10 @@ public:
 
     typedef std::shared_ptr<StreamBuffer> Pointer;
 
+    // called after bytes have been appended, with the stream id
+
+    typedef std::function<void (uint32_t)> WriteHandler;
+
     static Pointer create(const std::string &filename, const Zway::Packet &pkt);
 
     static Pointer open(const std::string &filename, uint32_t id);
@@ -99,6 +105,11 @@ public:
 
     size_t size();
 
+    // set once before the buffer is shared with other threads,
+    // write calls the handler without taking a lock
+
+    void setWriteHandler(const WriteHandler &handler);
+
 protected:
 
     StreamBuffer();
@@ -119,9 +130,14 @@ protected:
 
     uint32_t m_streamParts;
 
-    ThreadSafe<uint64_t> m_bytesReadable;
+    // bytesReadable is stored with release after the data is
+    // written, readers load it with acquire before reading
+
+    Atomic<uint64_t> m_bytesReadable;
+
+    Atomic<uint64_t> m_lastActivity;
 
-    ThreadSafe<uint64_t> m_lastActivity;
+    WriteHandler m_writeHandler;
 };
 
 typedef StreamBuffer::Pointer STREAM_BUFFER;
@@ -0,0 +1,101 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef TASK_H_
+#define TASK_H_
+
+#include "session.h"
+
+#include <boost/asio/coroutine.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+
+// ============================================================ //
+// Task
+// ============================================================ //
+
+/*
+ * Base of request handlers written as stackless coroutines. A task
+ * keeps its locals as members and resumes itself on the session
+ * strand once an awaited DB query completes, so a handler reads
+ * sequentially without blocking a thread. If the session closes
+ * while a query is pending the task is simply released.
+ */
+
+template <class Derived>
+class Task
+    : public boost::asio::coroutine,
+      public boost::enable_shared_from_this<Derived>
+{
+public:
+
+    typedef boost::shared_ptr<Derived> Pointer;
+
+    static Pointer create(const CLIENT_SESSION &session)
+    {
+        Pointer task(new Derived());
+
+        task->m_session = session;
+
+        return task;
+    }
+
+    void start()
+    {
+        (*static_cast<Derived*>(this))();
+    }
+
+protected:
+
+    // runs query on the db executor, stores the result in res and
+    // resumes the task on the strand, use as "yield await(...)"
+
+    template <class Query, class Result>
+    void await(Query query, Result &res)
+    {
+        Pointer self = this->shared_from_this();
+
+        Result *pres = &res;
+
+        m_session->template dbQuery<Result>(boost::function<Result ()>(query), [self, pres] (const Result &r) {
+
+            *pres = r;
+
+            (*self)();
+        });
+    }
+
+protected:
+
+    CLIENT_SESSION m_session;
+};
+
+// ============================================================ //
+
+#endif /* TASK_H_ */
@@ -30,8 +30,40 @@
 #ifndef THREAD_H_
 #define THREAD_H_
 
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include <atomic>
+#include <list>
+#include <type_traits>
+
+#ifdef ZWAY_LOCK_PROFILING
+#include "lockprofiler.h"
+#endif
+
+// ============================================================ //
+
+// with ZWAY_LOCK_PROFILING set every ThreadSafe lock records its
+// acquisitions, wait and hold times, otherwise it is a plain mutex
+
+#ifdef ZWAY_LOCK_PROFILING
+typedef ProfiledMutex ThreadSafeMutex;
+#else
+typedef boost::mutex ThreadSafeMutex;
+#endif
+
+// names a ThreadSafe lock in the lock profile
+
+struct LockName
+{
+    explicit LockName(const char *name)
+        : name(name)
+    {
+    }
+
+    const char *name;
+};
+
 // ============================================================ //
 // ThreadSafe
 // ============================================================ //
@@ -49,6 +81,28 @@ class ThreadSafe
             m_t = t;
         }
 
+#ifdef ZWAY_LOCK_PROFILING
+        ThreadSafe(const LockName &name)
+            : m_mutex(name.name)
+        {
+        }
+
+        ThreadSafe(T t, const LockName &name)
+            : m_mutex(name.name)
+        {
+            m_t = t;
+        }
+#else
+        ThreadSafe(const LockName &)
+        {
+        }
+
+        ThreadSafe(T t, const LockName &)
+        {
+            m_t = t;
+        }
+#endif
+
         ThreadSafe& operator=(T t)
         {
             m_t = t;
@@ -76,7 +130,7 @@ class ThreadSafe
             return &m_t;
         }
 
-        operator boost::mutex&()
+        operator ThreadSafeMutex&()
         {
             return m_mutex;
         }
@@ -85,7 +139,133 @@ class ThreadSafe
 
         T m_t;
 
-        boost::mutex m_mutex;
+        ThreadSafeMutex m_mutex;
+};
+
+// ============================================================ //
+// Atomic
+// ============================================================ //
+
+/*
+ * Lock-free replacement for ThreadSafe<T> when T is a single
+ * scalar. Loads default to acquire and stores to release, so a
+ * value published with store makes the writes before it visible
+ * to whoever loads it. Counters that order nothing can pass
+ * std::memory_order_relaxed.
+ */
+
+template <class T>
+class Atomic
+{
+    static_assert(std::is_scalar<T>::value, "Atomic<T> requires a scalar type");
+
+    public:
+        Atomic(T t = T())
+            : m_t(t)
+        {
+        }
+
+        T load(std::memory_order order = std::memory_order_acquire) const
+        {
+            return m_t.load(order);
+        }
+
+        void store(T t, std::memory_order order = std::memory_order_release)
+        {
+            m_t.store(t, order);
+        }
+
+        T exchange(T t, std::memory_order order = std::memory_order_acq_rel)
+        {
+            return m_t.exchange(t, order);
+        }
+
+        T fetchAdd(T t, std::memory_order order = std::memory_order_acq_rel)
+        {
+            return m_t.fetch_add(t, order);
+        }
+
+        operator T() const
+        {
+            return load();
+        }
+
+        Atomic& operator=(T t)
+        {
+            store(t);
+
+            return *this;
+        }
+
+    protected:
+
+        std::atomic<T> m_t;
+};
+
+// ============================================================ //
+// PerThread
+// ============================================================ //
+
+/*
+ * One instance of T per thread, for statistics and pools written
+ * on hot paths. local() returns the instance of the calling thread
+ * and creates it on first use, visit() walks all of them under the
+ * registry lock. Instances stay registered after their thread has
+ * exited, so nothing recorded there is lost and objects handed out
+ * by a pool may still refer to it. There is one registry per type.
+ */
+
+template <class T>
+class PerThread
+{
+    public:
+        static T &local()
+        {
+            // the registry owns the instance, the thread only caches
+            // a plain pointer, so lookups don't touch a refcount
+
+            static thread_local T *instance = nullptr;
+
+            if (!instance) {
+
+                boost::shared_ptr<T> p(new T());
+
+                boost::mutex::scoped_lock locker(mutex());
+
+                instances().push_back(p);
+
+                instance = p.get();
+            }
+
+            return *instance;
+        }
+
+        template <class Visitor>
+        static void visit(Visitor visitor)
+        {
+            boost::mutex::scoped_lock locker(mutex());
+
+            for (boost::shared_ptr<T> &instance : instances()) {
+
+                visitor(*instance);
+            }
+        }
+
+    protected:
+
+        static boost::mutex &mutex()
+        {
+            static boost::mutex mutex;
+
+            return mutex;
+        }
+
+        static std::list<boost::shared_ptr<T>> &instances()
+        {
+            static std::list<boost::shared_ptr<T>> instances;
+
+            return instances;
+        }
 };
 
 // ============================================================ //
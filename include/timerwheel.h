@@ -0,0 +1,145 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <vector>
+
+// ============================================================ //
+
+#define TIMER_WHEEL_TICK 1000
+
+// ============================================================ //
+// TimerWheel
+// ============================================================ //
+
+/*
+ * Hashed timer wheel expiring idle entries in bulk. Entries only
+ * store their last activity time, which makes touching them a
+ * single atomic store. The wheel visits every slot once per
+ * revolution and either expires an entry or moves it to the slot
+ * of its new deadline.
+ *
+ * Besides the idle timeout an entry can arm one absolute deadline,
+ * which is checked on every tick and fires onDeadline once unless
+ * it is cleared before.
+ */
+
+class TimerWheel : public boost::enable_shared_from_this<TimerWheel>
+{
+public:
+
+    class Entry
+    {
+    public:
+
+        Entry();
+
+        virtual ~Entry();
+
+        uint64_t lastActivity();
+
+        void cancel();
+
+        bool cancelled();
+
+        virtual void onTimeout() = 0;
+
+        virtual void onDeadline();
+
+    protected:
+
+        std::atomic<uint64_t> m_lastActivity;
+
+        std::atomic<bool> m_cancelled;
+
+        friend class TimerWheel;
+    };
+
+    typedef boost::shared_ptr<TimerWheel> Pointer;
+
+    static Pointer create(boost::asio::io_service &io_service, uint32_t timeout, uint32_t tick = TIMER_WHEEL_TICK);
+
+    void start();
+
+    void stop();
+
+    void add(const boost::shared_ptr<Entry> &entry);
+
+    void touch(Entry &entry);
+
+    void setDeadline(const boost::shared_ptr<Entry> &entry, uint64_t deadline);
+
+    void clearDeadline(Entry &entry);
+
+    uint64_t now();
+
+protected:
+
+    TimerWheel(boost::asio::io_service &io_service, uint32_t timeout, uint32_t tick);
+
+    void schedule();
+
+    void onTick(const boost::system::error_code &error);
+
+    uint64_t clock();
+
+protected:
+
+    uint32_t m_timeout;
+
+    uint32_t m_tick;
+
+    std::atomic<uint64_t> m_now;
+
+    uint64_t m_cursor;
+
+    boost::asio::deadline_timer m_timer;
+
+    boost::mutex m_mutex;
+
+    std::vector<std::list<boost::weak_ptr<Entry>>> m_slots;
+
+    std::map<Entry*, std::pair<boost::weak_ptr<Entry>, uint64_t>> m_deadlines;
+};
+
+typedef TimerWheel::Pointer TIMER_WHEEL;
+
+// ============================================================ //
+
+#endif /* TIMER_WHEEL_H_ */
@@ -0,0 +1,109 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#ifndef TLS_SESSION_CACHE_H_
+#define TLS_SESSION_CACHE_H_
+
+#include <boost/thread/mutex.hpp>
+
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <deque>
+
+// ============================================================ //
+
+#define TLS_SESSION_CACHE_SIZE 20480
+
+#define TLS_TICKET_LIFETIME 3600
+
+// ============================================================ //
+// TlsSessionCache
+// ============================================================ //
+
+/*
+ * Server side tls session resumption. Session ids are kept in
+ * the ssl context's internal cache, which is shared by all
+ * worker threads. Session tickets are encrypted with in-memory
+ * keys that are rotated every ticket lifetime. The previous key
+ * is still accepted for one more lifetime, tickets issued with
+ * it are renewed.
+ */
+
+class TlsSessionCache
+{
+public:
+
+    static bool startup(SSL_CTX *ctx, uint32_t cacheSize, uint32_t ticketLifetime);
+
+    static void handshakeCompleted(SSL *ssl);
+
+    static uint64_t numResumedHandshakes();
+
+    static uint64_t numFullHandshakes();
+
+protected:
+
+    struct TicketKey
+    {
+        uint8_t name[16];
+
+        uint8_t aesKey[32];
+
+        uint8_t hmacKey[32];
+
+        time_t created;
+    };
+
+    static bool rotate(time_t now);
+
+    static int ticketKeyCallback(
+            SSL *ssl,
+            unsigned char *keyName,
+            unsigned char *iv,
+            EVP_CIPHER_CTX *ctx,
+            HMAC_CTX *hctx,
+            int enc);
+
+protected:
+
+    static uint32_t m_ticketLifetime;
+
+    static boost::mutex m_mutex;
+
+    static std::deque<TicketKey> m_keys;
+
+    static std::atomic<uint64_t> m_numResumed;
+
+    static std::atomic<uint64_t> m_numFull;
+};
+
+// ============================================================ //
+
+#endif /* TLS_SESSION_CACHE_H_ */
@@ -0,0 +1,200 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "accountcache.h"
+#include "metrics.h"
+
+#include <time.h>
+
+// ============================================================ //
+
+uint32_t AccountCache::m_shardSize = ACCOUNT_CACHE_SIZE / ACCOUNT_CACHE_SHARDS;
+
+uint32_t AccountCache::m_ttl = ACCOUNT_CACHE_TTL;
+
+AccountCache::Shards AccountCache::m_shards;
+
+// ============================================================ //
+// AccountCache
+// ============================================================ //
+
+AccountCache::Shard::Shard()
+    : version(0)
+{
+
+}
+
+// ============================================================ //
+
+void AccountCache::startup(uint32_t size, uint32_t ttl)
+{
+    // size 0 disables the cache
+
+    m_shardSize = (size + ACCOUNT_CACHE_SHARDS - 1) / ACCOUNT_CACHE_SHARDS;
+
+    m_ttl = ttl;
+}
+
+// ============================================================ //
+
+bool AccountCache::get(uint32_t accountId, mongo::BSONObj &res)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::mutex::scoped_lock locker(s.mutex);
+
+    auto it = s.index.find(accountId);
+
+    if (it == s.index.end()) {
+
+        Metrics::add(Metrics::AccountCacheMisses);
+
+        return false;
+    }
+
+    if (it->second->expires <= now()) {
+
+        s.entries.erase(it->second);
+
+        s.index.erase(it);
+
+        Metrics::add(Metrics::AccountCacheMisses);
+
+        return false;
+    }
+
+    s.entries.splice(s.entries.begin(), s.entries, it->second);
+
+    res = it->second->obj;
+
+    Metrics::add(Metrics::AccountCacheHits);
+
+    return true;
+}
+
+// ============================================================ //
+
+uint64_t AccountCache::version(uint32_t accountId)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::mutex::scoped_lock locker(s.mutex);
+
+    return s.version;
+}
+
+// ============================================================ //
+
+void AccountCache::put(uint32_t accountId, const mongo::BSONObj &obj, uint64_t version)
+{
+    if (!m_shardSize) {
+
+        return;
+    }
+
+    Shard &s = m_shards.shard(accountId);
+
+    boost::mutex::scoped_lock locker(s.mutex);
+
+    // something in this shard was written since the caller read it
+
+    if (version != s.version) {
+
+        return;
+    }
+
+    auto it = s.index.find(accountId);
+
+    if (it != s.index.end()) {
+
+        s.entries.erase(it->second);
+
+        s.index.erase(it);
+    }
+
+    s.entries.push_front({accountId, obj, now() + m_ttl});
+
+    s.index[accountId] = s.entries.begin();
+
+    while (s.entries.size() > m_shardSize) {
+
+        s.index.erase(s.entries.back().accountId);
+
+        s.entries.pop_back();
+    }
+}
+
+// ============================================================ //
+
+void AccountCache::invalidate(uint32_t accountId)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::mutex::scoped_lock locker(s.mutex);
+
+    s.version++;
+
+    auto it = s.index.find(accountId);
+
+    if (it != s.index.end()) {
+
+        s.entries.erase(it->second);
+
+        s.index.erase(it);
+    }
+}
+
+// ============================================================ //
+
+size_t AccountCache::size()
+{
+    size_t res = 0;
+
+    for (Shard &s : m_shards) {
+
+        boost::mutex::scoped_lock locker(s.mutex);
+
+        res += s.entries.size();
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+uint64_t AccountCache::now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec;
+}
+
+// ============================================================ //
@@ -28,25 +28,72 @@
 // ============================================================ //
 
 #include "db.h"
+#include "accountcache.h"
+#include "requestcounters.h"
 #include "logger.h"
+#include "metrics.h"
+
+#include "Zway/core/request.h"
 
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <list>
+#include <stdexcept>
 
 using namespace mongo;
 
 boost::mutex DB::m_mutex;
 
-boost::condition_variable DB::m_condition;
+std::string DB::m_address;
+
+DB::PoolOptions DB::m_options;
+
+std::deque<DB::Idle> DB::m_idle;
+
+std::deque<DB::Waiter*> DB::m_waiters;
+
+uint32_t DB::m_numConnections = 0;
+
+uint32_t DB::m_numBusy = 0;
+
+boost::shared_ptr<boost::asio::io_service> DB::m_executor;
 
-boost::mutex DB::m_connectionsMutex;
+boost::shared_ptr<boost::asio::io_service::work> DB::m_executorWork;
 
-std::queue<DB::Connection::Pointer> DB::m_connections;
+boost::thread_group DB::m_executorThreads;
+
+std::atomic<uint32_t> DB::m_queuedJobs(0);
+
+std::atomic<uint64_t> DB::m_accountIds(0);
+
+boost::mutex DB::m_accountIdsMutex;
 
 // ============================================================ //
 // DB
 // ============================================================ //
 
-bool DB::startup(const std::string& address, uint32_t numConnections)
+DB::PoolOptions::PoolOptions()
+    : minConnections(DB_MIN_CONNECTIONS),
+      maxConnections(DB_MAX_CONNECTIONS),
+      acquireTimeout(DB_ACQUIRE_TIMEOUT),
+      idleTimeout(DB_IDLE_TIMEOUT)
+{
+
+}
+
+// ============================================================ //
+
+DB::Waiter::Waiter()
+    : slot(false)
+{
+
+}
+
+// ============================================================ //
+
+bool DB::startup(const std::string& address, const PoolOptions &options)
 {
     mongo::Status status = mongo::client::initialize();
 
@@ -55,16 +102,42 @@ bool DB::startup(const std::string& address, uint32_t numConnections)
         return false;
     }
 
-    for (int32_t i=0; i<numConnections; ++i) {
+    m_address = address;
 
-        Connection::Pointer pc = Connection::create(address);
+    m_options = options;
 
-        if (!pc) {
+    m_options.maxConnections = std::max<uint32_t>(1, m_options.maxConnections);
+
+    m_options.minConnections = std::min(m_options.minConnections, m_options.maxConnections);
+
+    for (uint32_t i=0; i<m_options.minConnections; ++i) {
+
+        CONNECTION con = open();
+
+        if (!con) {
 
             return false;
         }
 
-        m_connections.push(pc);
+        m_idle.push_back({con, now()});
+
+        m_numConnections++;
+    }
+
+    // start executor
+
+    m_executor = boost::make_shared<boost::asio::io_service>();
+
+    m_executorWork = boost::make_shared<boost::asio::io_service::work>(*m_executor);
+
+    for (uint32_t i=0; i<m_options.maxConnections; ++i) {
+
+        boost::shared_ptr<boost::asio::io_service> executor = m_executor;
+
+        m_executorThreads.create_thread([executor] () {
+
+            executor->run();
+        });
     }
 
     return true;
@@ -74,49 +147,267 @@ bool DB::startup(const std::string& address, uint32_t numConnections)
 
 void DB::cleanup()
 {
-    // ...
+    // finish pending queries, then stop the executor
+
+    m_executorWork.reset();
+
+    m_executorThreads.join_all();
 
-    m_connections = std::queue<CONNECTION>();
+    m_executor.reset();
+
+    {
+        boost::mutex::scoped_lock locker(m_mutex);
+
+        m_idle.clear();
+
+        m_numConnections = 0;
+    }
 
     mongo::client::shutdown();
 }
 
 // ============================================================ //
 
+void DB::post(const boost::function<void ()> &job)
+{
+    if (!m_executor) {
+
+        LOG_ERROR << "DB executor not running";
+
+        return;
+    }
+
+    ++m_queuedJobs;
+
+    m_executor->post([job] () {
+
+        --m_queuedJobs;
+
+        try {
+
+            job();
+        }
+        catch (std::exception &e) {
+
+            LOG_ERROR << "DB job failed: " << e.what();
+        }
+    });
+}
+
+// ============================================================ //
+
+uint32_t DB::numQueuedJobs()
+{
+    return m_queuedJobs;
+}
+
+// ============================================================ //
+
+uint32_t DB::numIdleConnections()
+{
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    return m_idle.size();
+}
+
+// ============================================================ //
+
+uint32_t DB::numBusyConnections()
+{
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    return m_numBusy;
+}
+
+// ============================================================ //
+
+uint32_t DB::numConnections()
+{
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    return m_numConnections;
+}
+
+// ============================================================ //
+
+uint32_t DB::numWaiters()
+{
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    return m_waiters.size();
+}
+
+// ============================================================ //
+
 DB::Connection::LOCK DB::acquire()
 {
-    CONNECTION con = getConnection();
+    Metrics::add(Metrics::DbQueries);
 
-    if (!con) {
+    uint64_t start = now();
 
+    CONNECTION con;
+
+    bool create = false;
+
+    {
         boost::mutex::scoped_lock locker(m_mutex);
 
-        m_condition.wait_for(locker, boost::chrono::seconds(10));
+        if (!m_idle.empty()) {
+
+            con = m_idle.back().con;
+
+            m_idle.pop_back();
+        }
+        else
+        if (m_numConnections < m_options.maxConnections) {
+
+            m_numConnections++;
+
+            create = true;
+        }
+        else {
+
+            // queue up, release hands connections to the
+            // oldest waiter, so nobody can overtake
 
-        con = getConnection();
+            Waiter waiter;
+
+            m_waiters.push_back(&waiter);
+
+            waiter.condition.wait_for(
+                        locker,
+                        boost::chrono::milliseconds(m_options.acquireTimeout),
+                        [&waiter] () { return waiter.con || waiter.slot; });
+
+            if (!waiter.con && !waiter.slot) {
+
+                m_waiters.erase(std::find(m_waiters.begin(), m_waiters.end(), &waiter));
+
+                locker.unlock();
+
+                Metrics::add(Metrics::DbTimeouts);
+
+                Metrics::observe(Metrics::DbWait, now() - start);
+
+                LOG_ERROR << "No database connection available after " << m_options.acquireTimeout << "ms";
+
+                return Connection::Lock::create(nullptr);
+            }
+
+            con = waiter.con;
+
+            create = waiter.slot;
+        }
     }
 
-    if (con) {
+    if (!create && !con->healthy()) {
 
-        return Connection::Lock::create(con);
+        // the broken connection's slot stays with this caller,
+        // going back to the queue would let others overtake
+
+        LOG_ERROR << "Reopening broken database connection";
+
+        Metrics::add(Metrics::DbClosed);
+
+        con.reset();
+
+        create = true;
+    }
+
+    if (create) {
+
+        con = open();
+
+        if (!con) {
+
+            releaseSlot();
+
+            Metrics::observe(Metrics::DbWait, now() - start);
+
+            return Connection::Lock::create(nullptr);
+        }
+    }
+
+    {
+        boost::mutex::scoped_lock locker(m_mutex);
+
+        m_numBusy++;
     }
 
-    return nullptr;
+    Metrics::observe(Metrics::DbWait, now() - start);
+
+    return Connection::Lock::create(con);
 }
 
 // ============================================================ //
 
-DB::CONNECTION DB::getConnection()
+void DB::maintain()
 {
-    CONNECTION con;
+    std::list<CONNECTION> expired;
+
+    uint32_t missing = 0;
+
+    {
+        boost::mutex::scoped_lock locker(m_mutex);
 
-    boost::mutex::scoped_lock locker(m_connectionsMutex);
+        uint64_t t = now();
 
-    if (!m_connections.empty()) {
+        // the oldest idle connections are at the front
 
-        con = m_connections.front();
+        while (!m_idle.empty() &&
+               m_numConnections > m_options.minConnections &&
+               t - m_idle.front().since > (uint64_t)m_options.idleTimeout * 1000000) {
 
-        m_connections.pop();
+            expired.push_back(m_idle.front().con);
+
+            m_idle.pop_front();
+
+            m_numConnections--;
+        }
+
+        if (m_numConnections < m_options.minConnections) {
+
+            missing = m_options.minConnections - m_numConnections;
+
+            m_numConnections += missing;
+        }
+    }
+
+    Metrics::add(Metrics::DbClosed, expired.size());
+
+    // connections are opened by the executor, never by the caller
+
+    for (uint32_t i=0; i<missing; ++i) {
+
+        post([] () {
+
+            CONNECTION con = open();
+
+            if (con) {
+
+                release(con);
+            }
+            else {
+
+                releaseSlot();
+            }
+        });
+    }
+}
+
+// ============================================================ //
+
+DB::CONNECTION DB::open()
+{
+    CONNECTION con = Connection::create(m_address);
+
+    if (con) {
+
+        Metrics::add(Metrics::DbOpened);
+    }
+    else {
+
+        LOG_ERROR << "Failed to open database connection";
     }
 
     return con;
@@ -124,6 +415,60 @@ DB::CONNECTION DB::getConnection()
 
 // ============================================================ //
 
+void DB::release(CONNECTION con)
+{
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    if (!m_waiters.empty()) {
+
+        Waiter *waiter = m_waiters.front();
+
+        m_waiters.pop_front();
+
+        waiter->con = con;
+
+        waiter->condition.notify_one();
+    }
+    else {
+
+        m_idle.push_back({con, now()});
+    }
+}
+
+// ============================================================ //
+
+void DB::releaseSlot()
+{
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    // a dropped or failed connection lets the oldest waiter open a new one
+
+    if (!m_waiters.empty()) {
+
+        Waiter *waiter = m_waiters.front();
+
+        m_waiters.pop_front();
+
+        waiter->slot = true;
+
+        waiter->condition.notify_one();
+    }
+    else {
+
+        m_numConnections--;
+    }
+}
+
+// ============================================================ //
+
+uint64_t DB::now()
+{
+    return boost::chrono::duration_cast<boost::chrono::microseconds>(
+                boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================ //
+
 DB::Connection::Lock::Pointer DB::Connection::Lock::create(DB::Connection::Pointer con)
 {
     return LOCK(new Lock(con));
@@ -142,19 +487,29 @@ DB::Connection::Lock::~Lock()
 
 void DB::Connection::Lock::unlock()
 {
+    if (!m_con) {
+
+        return;
+    }
+
     {
-        boost::mutex::scoped_lock locker(m_connectionsMutex);
+        boost::mutex::scoped_lock locker(m_mutex);
 
-        m_connections.push(m_con);
+        m_numBusy--;
     }
 
-    boost::mutex::scoped_lock locker(m_mutex);
+    release(m_con);
 
-    m_condition.notify_one();
+    m_con.reset();
 }
 
 DBClientConnection *DB::Connection::Lock::db()
 {
+    if (!m_con) {
+
+        throw std::runtime_error("No database connection");
+    }
+
     return m_con->db();
 }
 
@@ -181,6 +536,20 @@ DBClientConnection *DB::Connection::db()
 
 // ============================================================ //
 
+bool DB::Connection::healthy()
+{
+    try {
+
+        return m_db && !m_db->isFailed() && m_db->isStillConnected();
+    }
+    catch (std::exception &) {
+
+        return false;
+    }
+}
+
+// ============================================================ //
+
 DB::Connection::Connection()
 {
 
@@ -215,34 +584,127 @@ bool DB::Connection::init(const std::string &address)
 // ============================================================ //
 
 uint32_t DB::newAccountId()
+{
+    for (;;) {
+
+        uint64_t ids = m_accountIds.fetch_add(1, std::memory_order_relaxed);
+
+        uint32_t id = (uint32_t)ids;
+
+        if (id < (uint32_t)(ids >> 32)) {
+
+            return id;
+        }
+
+        // block used up, the first thread to get here reserves
+        // the next one, the others retry once it is published
+
+        boost::mutex::scoped_lock locker(m_accountIdsMutex);
+
+        ids = m_accountIds.load(std::memory_order_relaxed);
+
+        if ((uint32_t)ids < (uint32_t)(ids >> 32)) {
+
+            continue;
+        }
+
+        uint32_t begin;
+
+        uint32_t end;
+
+        if (!reserveAccountIds(begin, end)) {
+
+            return 0;
+        }
+
+        m_accountIds.store(((uint64_t)end << 32) | begin, std::memory_order_relaxed);
+    }
+}
+
+// ============================================================ //
+
+bool DB::reserveAccountIds(uint32_t &begin, uint32_t &end)
 {
     Connection::LOCK lock = acquire();
 
     try {
 
-        BSONObj fieldsToReturn = BSON("id" << 1);
+        // the counter starts above the ids assigned before it existed,
+        // $max keeps this a no-op once it is ahead. Only called with
+        // m_accountIdsMutex held
 
-        std::unique_ptr<DBClientCursor> cursor = lock->db()->query("zway.accounts", Query().sort("id", -1), 1, 0, &fieldsToReturn);
+        static bool seeded = false;
 
-        if (cursor->more()) {
+        if (!seeded) {
+
+            long long maxId = 0;
+
+            BSONObj fieldsToReturn = BSON("id" << 1);
+
+            std::unique_ptr<DBClientCursor> cursor = lock->db()->query("zway.accounts", Query().sort("id", -1), 1, 0, &fieldsToReturn);
 
-            return cursor->next().getIntField("id") + 1;
+            if (cursor->more()) {
+
+                maxId = cursor->next().getIntField("id");
+            }
+
+            lock->db()->update("zway.counters", BSON("_id" << "accountId"), BSON("$max" << BSON("value" << maxId)), true);
+
+            seeded = true;
         }
+
+        BSONObj res;
+
+        BSONObj cmd = BSON(
+                    "findAndModify" << "counters" <<
+                    "query" << BSON("_id" << "accountId") <<
+                    "update" << BSON("$inc" << BSON("value" << (long long)ACCOUNT_ID_BLOCK)) <<
+                    "new" << true <<
+                    "upsert" << true);
+
+        if (!lock->db()->runCommand("zway", cmd, res)) {
+
+            LOG_ERROR << "Failed to reserve account ids: " << res["errmsg"].str();
+
+            return false;
+        }
+
+        // the counter holds the last id of the reserved block
+
+        long long last = res["value"].Obj()["value"].numberLong();
+
+        begin = last - ACCOUNT_ID_BLOCK + 1;
+
+        end = last + 1;
     }
     catch (std::exception& e) {
 
         LOG_ERROR << "Query failed: " << e.what();
 
-        return 0;
+        return false;
     }
 
-    return 1;
+    return true;
 }
 
 // ============================================================ //
 
 bool DB::getAccount(const BSONObj &query, const mongo::BSONObj &fieldsToReturn, BSONObj &res)
 {
+    if (query.nFields() == 1 && query.hasField("id") && query["id"].isNumber() && cachedFields(fieldsToReturn)) {
+
+        BSONObj account;
+
+        if (!getCachedAccount(query["id"].numberLong(), account)) {
+
+            return false;
+        }
+
+        res = project(account, fieldsToReturn);
+
+        return true;
+    }
+
     Connection::LOCK lock = acquire();
 
     try {
@@ -266,6 +728,119 @@ bool DB::getAccount(const BSONObj &query, const mongo::BSONObj &fieldsToReturn,
 
 // ============================================================ //
 
+bool DB::getCachedAccount(uint32_t accountId, BSONObj &res)
+{
+    if (AccountCache::get(accountId, res)) {
+
+        return true;
+    }
+
+    uint64_t version = AccountCache::version(accountId);
+
+    Connection::LOCK lock = acquire();
+
+    try {
+
+        BSONObj fieldsToReturn = cachedFields();
+
+        std::unique_ptr<DBClientCursor> cursor = lock->db()->query("zway.accounts", BSON("id" << accountId), 0, 0, &fieldsToReturn);
+
+        if (cursor->more()) {
+
+            res = cursor->next().copy();
+
+            AccountCache::put(accountId, res, version);
+
+            return true;
+        }
+    }
+    catch (std::exception& e) {
+
+        LOG_ERROR << "Failed to get account: " << e.what();
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+BSONObj DB::cachedFields()
+{
+    return BSON(
+                "id"          << 1 <<
+                "name"        << 1 <<
+                "phone"       << 1 <<
+                "findByName"  << 1 <<
+                "findByPhone" << 1 <<
+                "pass"        << 1 <<
+                "salt"        << 1 <<
+                "fcmToken"    << 1);
+}
+
+// ============================================================ //
+
+bool DB::cachedFields(const BSONObj &fieldsToReturn)
+{
+    // true for inclusion projections of cached fields only,
+    // anything else goes to the collection
+
+    BSONObj cached = cachedFields();
+
+    BSONObjIterator it(fieldsToReturn);
+
+    while (it.more()) {
+
+        BSONElement e = it.next();
+
+        if (std::string(e.fieldName()) == "_id") {
+
+            continue;
+        }
+
+        if (!e.trueValue() || !cached.hasField(e.fieldName())) {
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+BSONObj DB::project(const BSONObj &obj, const BSONObj &fieldsToReturn)
+{
+    // inclusion projection as the server applies it, _id is
+    // returned unless excluded, an empty projection keeps all
+
+    if (fieldsToReturn.isEmpty()) {
+
+        return obj;
+    }
+
+    BSONObjBuilder b;
+
+    BSONObjIterator it(obj);
+
+    while (it.more()) {
+
+        BSONElement e = it.next();
+
+        BSONElement f = fieldsToReturn[e.fieldName()];
+
+        bool include = std::string(e.fieldName()) == "_id" ? f.eoo() || f.trueValue() : f.trueValue();
+
+        if (include) {
+
+            b.append(e);
+        }
+    }
+
+    return b.obj();
+}
+
+// ============================================================ //
+
 bool DB::comparePhone(const std::string& p1, const std::string& p2)
 {
 	if (p1.empty() || p2.empty()) {
@@ -287,6 +862,8 @@ bool DB::setFcmToken(uint32_t accountId, const std::string &token)
 
         lock->db()->update("zway.accounts", BSON("id" << accountId), BSON("$set" << BSON("fcmToken" << token)));
 
+        AccountCache::invalidate(accountId);
+
         return true;
     }
     catch (std::exception& e) {
@@ -301,69 +878,94 @@ bool DB::setFcmToken(uint32_t accountId, const std::string &token)
 
 std::string DB::getFcmToken(uint32_t accountId)
 {
-    Connection::LOCK lock = acquire();
+    BSONObj account;
 
-    try {
-
-        BSONObj fieldsToReturn = BSON("fcmToken" << 1);
-
-        std::unique_ptr<DBClientCursor> cursor = lock->db()->query("zway.accounts", BSON("id" << accountId), 0, 0, &fieldsToReturn);
+    if (getCachedAccount(accountId, account) && account.hasField("fcmToken")) {
 
-        if (cursor->more()) {
+        return account["fcmToken"].str();
+    }
 
-            BSONObj obj = cursor->next();
+    return std::string();
+}
 
-            std::string token = obj["fcmToken"].String();
+// ============================================================ //
 
-            return token;
-        }
-    }
-    catch (std::exception& e) {
+uint32_t DB::numContactRequests(uint32_t accountId)
+{
+    return RequestCounters::get(accountId).contactRequests;
+}
 
-        LOG_ERROR << "Failed to get fcm token: " << e.what();
-    }
+// ============================================================ //
 
-    return std::string();
+uint32_t DB::numPushRequests(uint32_t accountId)
+{
+    return RequestCounters::get(accountId).pushRequests;
 }
 
 // ============================================================ //
 
-uint32_t DB::numContactRequests(uint32_t accountId)
+bool DB::getNotificationInfo(uint32_t accountId, NotificationInfo &info)
 {
-    Connection::LOCK lock = acquire();
+    RequestCounters::Counts counts = RequestCounters::get(accountId);
 
-    uint32_t res = -1;
+    info.numContactRequests = counts.contactRequests;
 
-    try {
+    info.numPushRequests = counts.pushRequests;
 
-        res = lock->db()->count("zway.requests", BSON("dst" << accountId << "type" << 3100));
-    }
-    catch (std::exception& e) {
+    // nothing to notify about, spare the token lookup
 
-        LOG_ERROR << e.what();
+    if (!info.numContactRequests && !info.numPushRequests) {
+
+        return false;
     }
 
-    return res;
+    info.fcmToken = getFcmToken(accountId);
+
+    return !info.fcmToken.empty();
 }
 
 // ============================================================ //
 
-uint32_t DB::numPushRequests(uint32_t accountId)
+bool DB::loadRequestCounters()
 {
     Connection::LOCK lock = acquire();
 
-    uint32_t res = -1;
-
     try {
 
-        res = lock->db()->count("zway.requests", BSON("dst" << accountId << "type" << 4100));
+        RequestCounters::Map counts;
+
+        BSONObj query = BSON("type" << BSON("$in" << BSON_ARRAY(Zway::Request::AddContact << Zway::Request::Push)));
+
+        BSONObj fieldsToReturn = BSON("dst" << 1 << "type" << 1);
+
+        std::unique_ptr<DBClientCursor> cursor = lock->db()->query("zway.requests", query, 0, 0, &fieldsToReturn);
+
+        while (cursor->more()) {
+
+            BSONObj obj = cursor->next();
+
+            RequestCounters::Counts &c = counts[obj["dst"].numberLong()];
+
+            if (obj["type"].numberInt() == Zway::Request::AddContact) {
+
+                c.contactRequests++;
+            }
+            else {
+
+                c.pushRequests++;
+            }
+        }
+
+        RequestCounters::load(counts);
+
+        return true;
     }
     catch (std::exception& e) {
 
-        LOG_ERROR << e.what();
+        LOG_ERROR << "Failed to load request counters: " << e.what();
     }
 
-    return res;
+    return false;
 }
 
 // ============================================================ //
@@ -391,6 +993,8 @@ bool DB::insertAccount(
                 "pass"        << pass <<
                 "salt"        << salt));
 
+        AccountCache::invalidate(id);
+
         return true;
     }
     catch (std::exception& e) {
@@ -441,6 +1045,11 @@ bool DB::addRequest(const BSONObj& data)
 
         lock->db()->insert("zway.requests", data);
 
+        if (data.hasField("dst") && data.hasField("type")) {
+
+            RequestCounters::add(data["dst"].numberLong(), data["type"].numberInt());
+        }
+
         return true;
     }
     catch (std::exception& e) {
@@ -453,13 +1062,115 @@ bool DB::addRequest(const BSONObj& data)
 
 // ============================================================ //
 
+bool DB::addRequests(const std::vector<BSONObj>& data, std::vector<size_t> &stored)
+{
+    stored.clear();
+
+    if (data.empty()) {
+
+        return true;
+    }
+
+    // documents written by this call, only these are counted
+
+    std::vector<size_t> inserted;
+
+    Connection::LOCK lock = acquire();
+
+    try {
+
+        lock->db()->insert("zway.requests", data);
+
+        for (size_t i=0; i<data.size(); ++i) {
+
+            stored.push_back(i);
+        }
+
+        inserted = stored;
+    }
+    catch (std::exception& e) {
+
+        LOG_ERROR << "Failed to add requests: " << e.what();
+    }
+
+    if (stored.empty()) {
+
+        // the driver stops at the first failing document and keeps
+        // the ones before it, so look up every document and insert
+        // the missing ones. the connection may be the cause, start
+        // over with a fresh one. documents found here may predate
+        // this call, they are stored but not counted again
+
+        lock->unlock();
+
+        lock = acquire();
+
+        for (size_t i=0; i<data.size(); ++i) {
+
+            try {
+
+                BSONObj query = BSON("id" << data[i]["id"].numberLong() << "dst" << data[i]["dst"].numberLong());
+
+                if (lock->db()->count("zway.requests", query) == 0) {
+
+                    lock->db()->insert("zway.requests", data[i]);
+
+                    inserted.push_back(i);
+                }
+
+                stored.push_back(i);
+            }
+            catch (std::exception& e) {
+
+                LOG_ERROR << "Failed to add request: " << e.what();
+            }
+        }
+    }
+
+    for (size_t i : inserted) {
+
+        const BSONObj &obj = data[i];
+
+        if (obj.hasField("dst") && obj.hasField("type")) {
+
+            RequestCounters::add(obj["dst"].numberLong(), obj["type"].numberInt());
+        }
+    }
+
+    return stored.size() == data.size();
+}
+
+// ============================================================ //
+
 bool DB::deleteRequest(const BSONObj& query)
 {
     Connection::LOCK lock = acquire();
 
     try {
 
-        lock->db()->remove("zway.requests", query, true);
+        // remove through findAndModify, to learn which counter to update
+
+        BSONObj res;
+
+        BSONObj cmd = BSON(
+                    "findAndModify" << "requests" <<
+                    "query" << query <<
+                    "remove" << true <<
+                    "fields" << BSON("dst" << 1 << "type" << 1));
+
+        if (!lock->db()->runCommand("zway", cmd, res)) {
+
+            LOG_ERROR << "Failed to delete request: " << res["errmsg"].str();
+
+            return false;
+        }
+
+        if (res["value"].type() == mongo::Object) {
+
+            BSONObj removed = res["value"].Obj();
+
+            RequestCounters::remove(removed["dst"].numberLong(), removed["type"].numberInt());
+        }
 
         return true;
     }
@@ -29,25 +29,127 @@
 
 #include "fcmsender.h"
 #include "logger.h"
+#include "metrics.h"
+
+#include <boost/chrono.hpp>
+#include <boost/make_shared.hpp>
 
 #include <sstream>
 
 const char *FcmSender::fcmUrl = "https://fcm.googleapis.com/fcm/send";
 const char *FcmSender::fcmServerKey = "AAAAPYes6ds:APA91bEy1dPjayq9vOzI-2pY2JB3FmtS6_wc8B1NT_LhJPjND_eBpnWK3u8zmcXEfGfC-eies-9WMTnRiOgDpfuNnWh-aHaqMeGwrNuGB92iFd2fchSP0Yselew1ZY3xjmcLvvsnWaIx";
 
+boost::shared_ptr<boost::asio::io_service> FcmSender::m_executor;
+
+boost::shared_ptr<boost::asio::io_service::work> FcmSender::m_executorWork;
+
+boost::thread_group FcmSender::m_executorThreads;
+
+uint32_t FcmSender::m_queueLimit = FCM_QUEUE_LIMIT;
+
+std::atomic<uint32_t> FcmSender::m_queued(0);
+
+std::atomic<uint32_t> FcmSender::m_inflight(0);
+
 // ============================================================ //
 
-bool FcmSender::startup()
+bool FcmSender::startup(uint32_t numThreads, uint32_t queueLimit)
 {
-    curl_global_init(CURL_GLOBAL_SSL);
+    if (curl_global_init(CURL_GLOBAL_SSL) != CURLE_OK) {
+
+        return false;
+    }
+
+    m_queueLimit = queueLimit;
+
+    // start executor
+
+    m_executor = boost::make_shared<boost::asio::io_service>();
+
+    m_executorWork = boost::make_shared<boost::asio::io_service::work>(*m_executor);
+
+    for (uint32_t i=0; i<std::max<uint32_t>(1, numThreads); ++i) {
+
+        boost::shared_ptr<boost::asio::io_service> executor = m_executor;
+
+        m_executorThreads.create_thread([executor] () {
+
+            executor->run();
+        });
+    }
+
+    return true;
 }
 
 void FcmSender::cleanup()
 {
+    // deliver pending messages, then stop the executor
+
+    m_executorWork.reset();
+
+    m_executorThreads.join_all();
+
+    m_executor.reset();
+
     curl_global_cleanup();
 }
 
+bool FcmSender::post(const std::string &token, uint32_t type, uint32_t numElements)
+{
+    if (!m_executor) {
+
+        LOG_ERROR << "FCM executor not running";
+
+        return false;
+    }
+
+    if (++m_queued > m_queueLimit) {
+
+        --m_queued;
+
+        Metrics::add(Metrics::FcmDropped);
+
+        return false;
+    }
+
+    m_executor->post([token, type, numElements] () {
+
+        --m_queued;
+
+        sendMessage(token, type, numElements);
+    });
+
+    return true;
+}
+
 bool FcmSender::sendMessage(const std::string &token, uint32_t type, uint32_t numElements)
+{
+    ++m_inflight;
+
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+    bool res = send(token, type, numElements);
+
+    Metrics::observe(Metrics::FcmSend, boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now() - start).count());
+
+    Metrics::add(res ? Metrics::FcmSent : Metrics::FcmFailed);
+
+    --m_inflight;
+
+    return res;
+}
+
+uint32_t FcmSender::numQueued()
+{
+    return m_queued;
+}
+
+uint32_t FcmSender::numInflight()
+{
+    return m_inflight;
+}
+
+bool FcmSender::send(const std::string &token, uint32_t type, uint32_t numElements)
 {
     CURL *curl = curl_easy_init();
 
@@ -0,0 +1,227 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "histogram.h"
+
+// ============================================================ //
+// Histogram
+// ============================================================ //
+
+Histogram::Pointer Histogram::create()
+{
+    return Pointer(new Histogram());
+}
+
+// ============================================================ //
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+// ============================================================ //
+
+void Histogram::record(uint64_t value)
+{
+    uint32_t bucket = bucketIndex(value);
+
+    // counts are only summed on read, relaxed is enough
+
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    m_count.fetch_add(1, std::memory_order_relaxed);
+
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+
+    while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+
+    }
+}
+
+// ============================================================ //
+
+void Histogram::merge(const Histogram &other)
+{
+    for (uint32_t i=0; i<HISTOGRAM_BUCKETS; ++i) {
+
+        m_buckets[i] += other.m_buckets[i];
+    }
+
+    m_count += other.m_count;
+
+    m_sum += other.m_sum;
+
+    uint64_t value = other.m_max;
+
+    uint64_t max = m_max;
+
+    while (value > max && !m_max.compare_exchange_weak(max, value)) {
+
+    }
+}
+
+// ============================================================ //
+
+void Histogram::reset()
+{
+    for (uint32_t i=0; i<HISTOGRAM_BUCKETS; ++i) {
+
+        m_buckets[i] = 0;
+    }
+
+    m_count = 0;
+
+    m_sum = 0;
+
+    m_max = 0;
+}
+
+// ============================================================ //
+
+uint64_t Histogram::count() const
+{
+    return m_count;
+}
+
+// ============================================================ //
+
+uint64_t Histogram::sum() const
+{
+    return m_sum;
+}
+
+// ============================================================ //
+
+uint64_t Histogram::max() const
+{
+    return m_max;
+}
+
+// ============================================================ //
+
+uint64_t Histogram::bucketCount(uint32_t bucket) const
+{
+    if (bucket >= HISTOGRAM_BUCKETS) {
+
+        return 0;
+    }
+
+    return m_buckets[bucket];
+}
+
+// ============================================================ //
+
+uint64_t Histogram::bucketBound(uint32_t bucket)
+{
+    if (bucket >= HISTOGRAM_BUCKETS - 1) {
+
+        return (uint64_t)1 << HISTOGRAM_RANGE_BITS;
+    }
+
+    // bucket g << bits | sub covers a range of width 2^(g-1)
+    // starting at (2^bits + sub) << (g-1), group 0 is linear
+
+    uint32_t group = bucket >> HISTOGRAM_SUB_BUCKET_BITS;
+
+    if (!group) {
+
+        return bucket + 1;
+    }
+
+    uint64_t sub = bucket & ((1 << HISTOGRAM_SUB_BUCKET_BITS) - 1);
+
+    return (((uint64_t)1 << HISTOGRAM_SUB_BUCKET_BITS) + sub + 1) << (group - 1);
+}
+
+// ============================================================ //
+
+uint32_t Histogram::bucketIndex(uint64_t value)
+{
+    if (value < ((uint64_t)1 << HISTOGRAM_SUB_BUCKET_BITS)) {
+
+        return (uint32_t)value;
+    }
+
+    if (value >> HISTOGRAM_RANGE_BITS) {
+
+        return HISTOGRAM_BUCKETS - 1;
+    }
+
+    // the top HISTOGRAM_SUB_BUCKET_BITS + 1 bits of the value select
+    // the bucket, the leading one offsets it into its group
+
+    uint32_t shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BUCKET_BITS;
+
+    return (shift << HISTOGRAM_SUB_BUCKET_BITS) + (uint32_t)(value >> shift);
+}
+
+// ============================================================ //
+
+uint64_t Histogram::percentile(double p) const
+{
+    // the bucket counts are read one by one, so a concurrent
+    // record may be missed, which is fine for reporting
+
+    uint64_t total = 0;
+
+    for (uint32_t i=0; i<HISTOGRAM_BUCKETS; ++i) {
+
+        total += m_buckets[i];
+    }
+
+    if (!total) {
+
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(p * total);
+
+    if (rank >= total) {
+
+        rank = total - 1;
+    }
+
+    uint64_t seen = 0;
+
+    for (uint32_t i=0; i<HISTOGRAM_BUCKETS; ++i) {
+
+        seen += m_buckets[i];
+
+        if (seen > rank) {
+
+            return i < HISTOGRAM_BUCKETS - 1 ? bucketBound(i) : m_max.load();
+        }
+    }
+
+    return m_max;
+}
+
+// ============================================================ //
@@ -0,0 +1,200 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "ioservicepool.h"
+
+// ============================================================ //
+// IoServicePool::Shard
+// ============================================================ //
+
+IO_SERVICE_SHARD IoServicePool::Shard::create(uint32_t index)
+{
+    return IO_SERVICE_SHARD(new Shard(index));
+}
+
+IoServicePool::Shard::Shard(uint32_t index)
+    : m_index(index),
+      m_load(0),
+      m_io_service(boost::make_shared<boost::asio::io_service>()),
+      m_work(boost::make_shared<boost::asio::io_service::work>(*m_io_service))
+{
+
+}
+
+boost::asio::io_service &IoServicePool::Shard::io_service()
+{
+    return *m_io_service;
+}
+
+boost::shared_ptr<boost::asio::io_service> IoServicePool::Shard::io_service_ptr()
+{
+    return m_io_service;
+}
+
+uint32_t IoServicePool::Shard::index()
+{
+    return m_index;
+}
+
+uint32_t IoServicePool::Shard::load()
+{
+    return m_load.load(std::memory_order_relaxed);
+}
+
+void IoServicePool::Shard::acquire()
+{
+    m_load.fetch_add(1, std::memory_order_relaxed);
+}
+
+void IoServicePool::Shard::release()
+{
+    m_load.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// ============================================================ //
+// IoServicePool
+// ============================================================ //
+
+IO_SERVICE_POOL IoServicePool::create(uint32_t numShards, uint32_t numThreadsPerShard, Balance balance)
+{
+    if (!numShards || !numThreadsPerShard) {
+
+        return nullptr;
+    }
+
+    return IO_SERVICE_POOL(new IoServicePool(numShards, numThreadsPerShard, balance));
+}
+
+IoServicePool::IoServicePool(uint32_t numShards, uint32_t numThreadsPerShard, Balance balance)
+    : m_numThreadsPerShard(numThreadsPerShard),
+      m_balance(balance),
+      m_next(0)
+{
+    for (uint32_t i=0; i<numShards; ++i) {
+
+        m_shards.push_back(Shard::create(i));
+    }
+}
+
+// ============================================================ //
+
+void IoServicePool::run()
+{
+    for (SHARD &shard : m_shards) {
+
+        for (uint32_t i=0; i<m_numThreadsPerShard; ++i) {
+
+            m_threads.create_thread(boost::bind(&IoServicePool::worker, shard->m_io_service));
+        }
+    }
+}
+
+// ============================================================ //
+
+void IoServicePool::stop()
+{
+    for (SHARD &shard : m_shards) {
+
+        shard->m_io_service->stop();
+    }
+}
+
+// ============================================================ //
+
+void IoServicePool::join()
+{
+    m_threads.join_all();
+}
+
+// ============================================================ //
+
+void IoServicePool::release()
+{
+    // let the shards run out of work, so the
+    // worker threads return once they are idle
+
+    for (SHARD &shard : m_shards) {
+
+        shard->m_work.reset();
+    }
+}
+
+// ============================================================ //
+
+IO_SERVICE_SHARD IoServicePool::shard(uint32_t index)
+{
+    return m_shards[index % m_shards.size()];
+}
+
+// ============================================================ //
+
+IO_SERVICE_SHARD IoServicePool::select()
+{
+    uint32_t next = m_next.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_balance == LeastLoad) {
+
+        // start scanning at the round robin position,
+        // so equally loaded shards are used in turns
+
+        SHARD res = m_shards[next % m_shards.size()];
+
+        for (size_t i=1; i<m_shards.size(); ++i) {
+
+            SHARD &shard = m_shards[(next + i) % m_shards.size()];
+
+            if (shard->load() < res->load()) {
+
+                res = shard;
+            }
+        }
+
+        return res;
+    }
+
+    return m_shards[next % m_shards.size()];
+}
+
+// ============================================================ //
+
+uint32_t IoServicePool::size()
+{
+    return m_shards.size();
+}
+
+// ============================================================ //
+
+void IoServicePool::worker(boost::shared_ptr<boost::asio::io_service> io_service)
+{
+    boost::system::error_code ec;
+
+    io_service->run(ec);
+}
+
+// ============================================================ //
@@ -0,0 +1,217 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "lockprofiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+// ============================================================ //
+
+boost::mutex LockProfiler::m_mutex;
+
+std::map<std::string, boost::shared_ptr<LockProfiler::Site>> LockProfiler::m_sites;
+
+// ============================================================ //
+
+static void updateMax(std::atomic<uint64_t> &max, uint64_t value)
+{
+    uint64_t cur = max.load(std::memory_order_relaxed);
+
+    while (value > cur && !max.compare_exchange_weak(cur, value, std::memory_order_relaxed));
+}
+
+// ============================================================ //
+// LockProfiler
+// ============================================================ //
+
+LockProfiler::Site::Site(const std::string &name)
+    : name(name),
+      acquisitions(0),
+      contended(0),
+      waitTime(0),
+      holdTime(0),
+      maxWait(0),
+      maxHold(0)
+{
+
+}
+
+// ============================================================ //
+
+LockProfiler::Site *LockProfiler::site(const char *name)
+{
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    boost::shared_ptr<Site> &site = m_sites[name];
+
+    if (!site) {
+
+        site.reset(new Site(name));
+    }
+
+    // sites are never removed, the pointer stays valid
+
+    return site.get();
+}
+
+// ============================================================ //
+
+std::vector<LockProfiler::Stats> LockProfiler::stats()
+{
+    std::vector<Stats> res;
+
+    {
+        boost::mutex::scoped_lock locker(m_mutex);
+
+        for (auto &it : m_sites) {
+
+            Site &site = *it.second;
+
+            Stats stats;
+
+            stats.name = site.name;
+
+            stats.acquisitions = site.acquisitions.load(std::memory_order_relaxed);
+
+            stats.contended = site.contended.load(std::memory_order_relaxed);
+
+            stats.waitTime = site.waitTime.load(std::memory_order_relaxed);
+
+            stats.holdTime = site.holdTime.load(std::memory_order_relaxed);
+
+            stats.maxWait = site.maxWait.load(std::memory_order_relaxed);
+
+            stats.maxHold = site.maxHold.load(std::memory_order_relaxed);
+
+            res.push_back(stats);
+        }
+    }
+
+    std::sort(res.begin(), res.end(), [] (const Stats &a, const Stats &b) {
+
+        return a.waitTime > b.waitTime;
+    });
+
+    return res;
+}
+
+// ============================================================ //
+
+std::string LockProfiler::report()
+{
+    std::stringstream ss;
+
+    ss << "Lock profile:\n";
+
+    for (Stats &stats : stats()) {
+
+        ss << stats.name << ": acquired " << stats.acquisitions <<
+              ", contended " << stats.contended <<
+              ", wait " << stats.waitTime / 1000 << "us (max " << stats.maxWait / 1000 << "us)" <<
+              ", hold " << stats.holdTime / 1000 << "us (max " << stats.maxHold / 1000 << "us)\n";
+    }
+
+    return ss.str();
+}
+
+// ============================================================ //
+
+uint64_t LockProfiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================ //
+// ProfiledMutex
+// ============================================================ //
+
+ProfiledMutex::ProfiledMutex(const char *name)
+    : m_site(LockProfiler::site(name)),
+      m_lockedAt(0)
+{
+
+}
+
+// ============================================================ //
+
+void ProfiledMutex::lock()
+{
+    if (!m_mutex.try_lock()) {
+
+        uint64_t start = LockProfiler::now();
+
+        m_mutex.lock();
+
+        uint64_t wait = LockProfiler::now() - start;
+
+        m_site->contended.fetch_add(1, std::memory_order_relaxed);
+
+        m_site->waitTime.fetch_add(wait, std::memory_order_relaxed);
+
+        updateMax(m_site->maxWait, wait);
+    }
+
+    m_site->acquisitions.fetch_add(1, std::memory_order_relaxed);
+
+    m_lockedAt = LockProfiler::now();
+}
+
+// ============================================================ //
+
+bool ProfiledMutex::try_lock()
+{
+    if (!m_mutex.try_lock()) {
+
+        return false;
+    }
+
+    m_site->acquisitions.fetch_add(1, std::memory_order_relaxed);
+
+    m_lockedAt = LockProfiler::now();
+
+    return true;
+}
+
+// ============================================================ //
+
+void ProfiledMutex::unlock()
+{
+    uint64_t hold = LockProfiler::now() - m_lockedAt;
+
+    m_mutex.unlock();
+
+    m_site->holdTime.fetch_add(hold, std::memory_order_relaxed);
+
+    updateMax(m_site->maxHold, hold);
+}
+
+// ============================================================ //
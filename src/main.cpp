@@ -51,26 +51,13 @@ namespace expressions = boost::log::expressions;
 
 #define LOG_FILENAME "/var/log/zway"
 
-boost::shared_ptr<boost::asio::io_service> io_service =
-        boost::make_shared<boost::asio::io_service>();
-
-boost::shared_ptr<boost::asio::io_service::work> work =
-        boost::make_shared<boost::asio::io_service::work>(*io_service);
-
-// ============================================================ //
-
-void worker(boost::shared_ptr<boost::asio::io_service> io_service)
-{
-    boost::system::error_code ec;
-
-    io_service->run(ec);
-}
+IO_SERVICE_POOL ioPool;
 
 // ============================================================ //
 
 void signal_handler(int sig)
 {
-	io_service->stop();
+	ioPool->stop();
 }
 
 // ============================================================ //
@@ -93,6 +80,14 @@ int main(int argc, char** argv)
 
     int32_t numWorkers;
 
+    std::string balance;
+
+    uint32_t fcmThreads;
+
+    uint32_t fcmQueueLimit;
+
+    Server::Options serverOptions;
+
     po::options_description desc("Options");
 
     desc.add_options()
@@ -103,7 +98,49 @@ int main(int argc, char** argv)
         ("port,p",
             po::value<int32_t>(&port)->default_value(ZWAY_PORT), "port to use")
         ("num-workers,n",
-            po::value<int32_t>(&numWorkers)->default_value(NUM_WORKERS), "number of worker threads")
+            po::value<int32_t>(&numWorkers)->default_value(NUM_WORKERS), "number of io_service shards, one thread each")
+        ("shared-io",
+            "run a single io_service shared by all worker threads")
+        ("balance",
+            po::value<std::string>(&balance)->default_value("round-robin"), "session to shard balancing (round-robin, least-load)")
+        ("num-acceptors",
+            po::value<uint32_t>(&serverOptions.numAcceptors)->default_value(NUM_ACCEPTORS), "number of SO_REUSEPORT acceptors")
+        ("pending-accepts",
+            po::value<uint32_t>(&serverOptions.pendingAccepts)->default_value(NUM_PENDING_ACCEPTS), "outstanding accepts per acceptor")
+        ("send-batch-bytes",
+            po::value<uint32_t>(&serverOptions.sendBatchBytes)->default_value(SEND_BATCH_BYTES), "max bytes coalesced into one session write")
+        ("send-batch-packets",
+            po::value<uint32_t>(&serverOptions.sendBatchPackets)->default_value(SEND_BATCH_PACKETS), "max packets coalesced into one session write")
+        ("send-queue-low",
+            po::value<uint32_t>(&serverOptions.sendQueueLowWatermark)->default_value(SEND_QUEUE_LOW_WATERMARK), "outbound queue bytes below which stream senders resume")
+        ("send-queue-high",
+            po::value<uint32_t>(&serverOptions.sendQueueHighWatermark)->default_value(SEND_QUEUE_HIGH_WATERMARK), "outbound queue bytes above which stream senders pause")
+        ("send-queue-limit",
+            po::value<uint32_t>(&serverOptions.sendQueueHardLimit)->default_value(SEND_QUEUE_HARD_LIMIT), "outbound queue bytes after which slow consumers are dropped")
+        ("bulk-share",
+            po::value<uint32_t>(&serverOptions.bulkShare)->default_value(BULK_MIN_SHARE), "minimum percentage of each write reserved for bulk streams")
+        ("tls-cache-size",
+            po::value<uint32_t>(&serverOptions.tlsCacheSize)->default_value(TLS_SESSION_CACHE_SIZE), "tls session cache entries")
+        ("tls-ticket-lifetime",
+            po::value<uint32_t>(&serverOptions.tlsTicketLifetime)->default_value(TLS_TICKET_LIFETIME), "tls session ticket key lifetime in seconds")
+        ("db-min-connections",
+            po::value<uint32_t>(&serverOptions.dbMinConnections)->default_value(DB_MIN_CONNECTIONS), "database connections kept open")
+        ("db-max-connections",
+            po::value<uint32_t>(&serverOptions.dbMaxConnections)->default_value(DB_MAX_CONNECTIONS), "upper bound of the database pool")
+        ("db-acquire-timeout",
+            po::value<uint32_t>(&serverOptions.dbAcquireTimeout)->default_value(DB_ACQUIRE_TIMEOUT), "milliseconds a query waits for a database connection")
+        ("db-idle-timeout",
+            po::value<uint32_t>(&serverOptions.dbIdleTimeout)->default_value(DB_IDLE_TIMEOUT), "seconds before idle connections above the minimum are closed")
+        ("account-cache-size",
+            po::value<uint32_t>(&serverOptions.accountCacheSize)->default_value(ACCOUNT_CACHE_SIZE), "cached accounts, 0 to disable")
+        ("account-cache-ttl",
+            po::value<uint32_t>(&serverOptions.accountCacheTtl)->default_value(ACCOUNT_CACHE_TTL), "seconds an account stays cached")
+        ("fcm-threads",
+            po::value<uint32_t>(&fcmThreads)->default_value(FCM_THREADS), "threads delivering push notifications")
+        ("fcm-queue-limit",
+            po::value<uint32_t>(&fcmQueueLimit)->default_value(FCM_QUEUE_LIMIT), "pending push notifications before new ones are dropped")
+        ("metrics-port",
+            po::value<uint32_t>(&serverOptions.metricsPort)->default_value(METRICS_PORT), "local port of the metrics endpoint, 0 to disable")
         ("daemon,d",
             "start daemon");
 
@@ -131,6 +168,28 @@ int main(int argc, char** argv)
         return -1;
     }
 
+    if (balance != "round-robin" && balance != "least-load") {
+
+        std::cerr << "invalid balance: " << balance << "\n";
+
+        desc.print(std::cout);
+
+        return -1;
+    }
+
+    numWorkers = std::max(1, std::min(numWorkers, MAX_WORKERS));
+
+    if (vm.count("shared-io")) {
+
+        ioPool = IoServicePool::create(1, numWorkers);
+    }
+    else {
+
+        ioPool = IoServicePool::create(
+                    numWorkers, 1,
+                    balance == "least-load" ? IoServicePool::LeastLoad : IoServicePool::RoundRobin);
+    }
+
     if (vm.count("daemon")) {
 
 		// fork parent process
@@ -212,35 +271,56 @@ int main(int argc, char** argv)
 
     logging::add_common_attributes();
 
-    // init worker thread pool
-
-    boost::thread_group workers;
+    // init worker threads
 
-    for (uint32_t i=0; i<numWorkers && i<MAX_WORKERS; i++) {
+    ioPool->run();
 
-        workers.create_thread(boost::bind(&worker, io_service));
-    }
 
+    if (!FcmSender::startup(fcmThreads, fcmQueueLimit)) {
 
-    FcmSender::startup();
+        LOG_ERROR << "Failed to start FCM sender";
+    }
 
 
     // init server
 
-    Server server(io_service);
+    Server server(ioPool);
 
-    if (!server.start(workingDir, address, port)) {
+    if (!server.start(workingDir, address, port, serverOptions)) {
 
         return -1;
     }
 
+    // SIGUSR2 logs the first page of the status snapshot
+
+    boost::asio::signal_set infoSignal(ioPool->shard(0)->io_service(), SIGUSR2);
+
+    std::function<void (const boost::system::error_code&, int)> onInfoSignal =
+            [&server, &infoSignal, &onInfoSignal] (const boost::system::error_code &error, int) {
+
+        if (error) {
+
+            return;
+        }
+
+        server.info();
+
+        infoSignal.async_wait(onInfoSignal);
+    };
+
+    infoSignal.async_wait(onInfoSignal);
+
     if (vm.count("daemon")) {
 
-        io_service->run();
+        // wait until the signal handler stops the shards
+
+        ioPool->join();
     }
     else {
 
-        //LOG_INFO("Controls:\np -> pause/resume server\nr -> remove sessions\ni -> info\ne -> exit");
+        //LOG_INFO("Controls:\np -> pause/resume server\nr -> remove sessions\ni -> info\nn -> next info page\ne -> exit");
+
+        uint32_t infoOffset = 0;
 
         for (;;) {
 
@@ -256,10 +336,20 @@ int main(int argc, char** argv)
 
             		case 'i':
 
-            			server.info();
+            		    infoOffset = 0;
+
+            			server.info(infoOffset);
 
             			break;
 
+            		case 'n':
+
+            		    infoOffset += STATUS_PAGE_SIZE;
+
+            		    server.info(infoOffset);
+
+            		    break;
+
             		case 'r':
 
             		    server.removeSessions();
@@ -288,13 +378,17 @@ int main(int argc, char** argv)
         }
     }
 
+    boost::system::error_code ec;
+
+    infoSignal.cancel(ec);
+
     server.close();
 
     // nothing to do anymore
 
-    work.reset();
+    ioPool->release();
 
-    workers.join_all();
+    ioPool->join();
 
 
     FcmSender::cleanup();
@@ -0,0 +1,93 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "metrics.h"
+
+// ============================================================ //
+// Metrics
+// ============================================================ //
+
+Metrics::Block::Block()
+{
+    for (uint32_t i=0; i<NumCounters; ++i) {
+
+        counters[i] = 0;
+    }
+
+    for (uint32_t i=0; i<NumTimers; ++i) {
+
+        timers[i] = Histogram::create();
+    }
+}
+
+// ============================================================ //
+
+void Metrics::add(Counter counter, uint64_t value)
+{
+    // only the owning thread writes, relaxed is enough
+
+    Blocks::local().counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+// ============================================================ //
+
+void Metrics::observe(Timer timer, uint64_t value)
+{
+    Blocks::local().timers[timer]->record(value);
+}
+
+// ============================================================ //
+
+uint64_t Metrics::counter(Counter counter)
+{
+    uint64_t res = 0;
+
+    Blocks::visit([&res, counter] (Block &block) {
+
+        res += block.counters[counter].load(std::memory_order_relaxed);
+    });
+
+    return res;
+}
+
+// ============================================================ //
+
+HISTOGRAM Metrics::timer(Timer timer)
+{
+    HISTOGRAM res = Histogram::create();
+
+    Blocks::visit([&res, timer] (Block &block) {
+
+        res->merge(*block.timers[timer]);
+    });
+
+    return res;
+}
+
+// ============================================================ //
@@ -0,0 +1,389 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "metricsexporter.h"
+#include "logger.h"
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+// ============================================================ //
+// MetricsExporter
+// ============================================================ //
+
+METRICS_EXPORTER MetricsExporter::create()
+{
+    return METRICS_EXPORTER(new MetricsExporter());
+}
+
+// ============================================================ //
+
+MetricsExporter::MetricsExporter()
+    : m_acceptor(m_io_service)
+{
+
+}
+
+// ============================================================ //
+
+void MetricsExporter::addHandler(const std::string &path, const Handler &handler)
+{
+    m_handlers[path] = handler;
+}
+
+// ============================================================ //
+
+bool MetricsExporter::start(const std::string &address, uint16_t port)
+{
+    try {
+
+        boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address::from_string(address), port);
+
+        m_acceptor.open(endpoint.protocol());
+
+        m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+
+        m_acceptor.bind(endpoint);
+
+        m_acceptor.listen();
+    }
+    catch (std::exception &e) {
+
+        LOG_ERROR << "Failed to start metrics endpoint: " << e.what();
+
+        return false;
+    }
+
+    accept();
+
+    m_work = boost::make_shared<boost::asio::io_service::work>(m_io_service);
+
+    m_thread = boost::thread([this] () {
+
+        m_io_service.run();
+    });
+
+    LOG_INFO << "Metrics endpoint listening on " << address << ":" << port;
+
+    return true;
+}
+
+// ============================================================ //
+
+void MetricsExporter::stop()
+{
+    // close the acceptor on the exporter thread, the thread returns
+    // once open connections are done or have timed out
+
+    m_io_service.post([this] () {
+
+        boost::system::error_code ec;
+
+        m_acceptor.close(ec);
+    });
+
+    m_work.reset();
+
+    if (m_thread.joinable()) {
+
+        m_thread.join();
+    }
+}
+
+// ============================================================ //
+
+void MetricsExporter::accept()
+{
+    Connection::Pointer connection(new Connection(m_io_service, shared_from_this()));
+
+    m_acceptor.async_accept(
+                connection->socket(),
+                boost::bind(
+                    &MetricsExporter::onAccept,
+                    shared_from_this(),
+                    boost::asio::placeholders::error,
+                    connection));
+}
+
+// ============================================================ //
+
+void MetricsExporter::onAccept(const boost::system::error_code &error, Connection::Pointer connection)
+{
+    if (error == boost::asio::error::operation_aborted) {
+
+        return;
+    }
+
+    if (!error) {
+
+        connection->start();
+    }
+
+    accept();
+}
+
+// ============================================================ //
+
+void MetricsExporter::writeHeader(std::ostream &os, const std::string &name, const std::string &type, const std::string &help)
+{
+    os << "# HELP " << name << " " << help << "\n";
+
+    os << "# TYPE " << name << " " << type << "\n";
+}
+
+// ============================================================ //
+
+void MetricsExporter::writeValue(std::ostream &os, const std::string &name, const std::string &labels, double value)
+{
+    os << name;
+
+    if (!labels.empty()) {
+
+        os << "{" << labels << "}";
+    }
+
+    os << " " << std::setprecision(std::numeric_limits<double>::max_digits10) << value << "\n";
+}
+
+// ============================================================ //
+
+void MetricsExporter::writeValue(std::ostream &os, const std::string &name, const std::string &labels, uint64_t value)
+{
+    os << name;
+
+    if (!labels.empty()) {
+
+        os << "{" << labels << "}";
+    }
+
+    os << " " << value << "\n";
+}
+
+// ============================================================ //
+
+void MetricsExporter::writeHistogram(std::ostream &os, const std::string &name, const std::string &labels, const Histogram &histogram)
+{
+    std::string prefix = labels.empty() ? std::string() : labels + ",";
+
+    // buckets are cumulative, empty ones at the top are left out
+
+    uint32_t last = 0;
+
+    for (uint32_t i=0; i<HISTOGRAM_BUCKETS; ++i) {
+
+        if (histogram.bucketCount(i)) {
+
+            last = i;
+        }
+    }
+
+    // only the last sub-bucket of each power of two is written, so
+    // the bounds stay powers of two, percentiles use all of them
+
+    uint32_t mask = (1 << HISTOGRAM_SUB_BUCKET_BITS) - 1;
+
+    uint64_t count = 0;
+
+    for (uint32_t i=0; i<=(last | mask) && i<HISTOGRAM_BUCKETS-1; ++i) {
+
+        count += histogram.bucketCount(i);
+
+        if ((i & mask) != mask) {
+
+            continue;
+        }
+
+        std::stringstream le;
+
+        le << prefix << "le=\"" << std::setprecision(std::numeric_limits<double>::max_digits10) << Histogram::bucketBound(i) / 1e6 << "\"";
+
+        writeValue(os, name + "_bucket", le.str(), count);
+    }
+
+    writeValue(os, name + "_bucket", prefix + "le=\"+Inf\"", histogram.count());
+
+    writeValue(os, name + "_sum", labels, histogram.sum() / 1e6);
+
+    writeValue(os, name + "_count", labels, histogram.count());
+}
+
+// ============================================================ //
+// MetricsExporter::Connection
+// ============================================================ //
+
+MetricsExporter::Connection::Connection(boost::asio::io_service &io_service, MetricsExporter::Pointer exporter)
+    : m_exporter(exporter),
+      m_socket(io_service),
+      m_timer(io_service),
+      m_request(METRICS_MAX_REQUEST)
+{
+
+}
+
+// ============================================================ //
+
+boost::asio::ip::tcp::socket &MetricsExporter::Connection::socket()
+{
+    return m_socket;
+}
+
+// ============================================================ //
+
+void MetricsExporter::Connection::start()
+{
+    // idle or slow scrapers must not hold on to their socket
+
+    m_timer.expires_from_now(boost::posix_time::milliseconds(METRICS_TIMEOUT));
+
+    m_timer.async_wait(
+                boost::bind(
+                    &Connection::onTimeout,
+                    shared_from_this(),
+                    boost::asio::placeholders::error));
+
+    boost::asio::async_read_until(
+                m_socket,
+                m_request,
+                "\r\n\r\n",
+                boost::bind(
+                    &Connection::onRead,
+                    shared_from_this(),
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred));
+}
+
+// ============================================================ //
+
+void MetricsExporter::Connection::onTimeout(const boost::system::error_code &error)
+{
+    if (error) {
+
+        return;
+    }
+
+    boost::system::error_code ec;
+
+    m_socket.close(ec);
+}
+
+// ============================================================ //
+
+void MetricsExporter::Connection::onRead(const boost::system::error_code &error, size_t)
+{
+    if (error) {
+
+        boost::system::error_code ec;
+
+        m_timer.cancel(ec);
+
+        return;
+    }
+
+    std::istream is(&m_request);
+
+    std::string method;
+
+    std::string target;
+
+    is >> method >> target;
+
+    if (method != "GET") {
+
+        respond("405 Method Not Allowed", std::string());
+
+        return;
+    }
+
+    std::string path = target;
+
+    std::string query;
+
+    size_t pos = target.find('?');
+
+    if (pos != std::string::npos) {
+
+        path = target.substr(0, pos);
+
+        query = target.substr(pos + 1);
+    }
+
+    auto it = m_exporter->m_handlers.find(path);
+
+    if (it == m_exporter->m_handlers.end()) {
+
+        respond("404 Not Found", std::string());
+
+        return;
+    }
+
+    respond("200 OK", it->second(query));
+}
+
+// ============================================================ //
+
+void MetricsExporter::Connection::respond(const std::string &status, const std::string &body)
+{
+    std::stringstream ss;
+
+    ss << "HTTP/1.0 " << status << "\r\n" <<
+          "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n" <<
+          "Content-Length: " << body.size() << "\r\n" <<
+          "Connection: close\r\n\r\n" <<
+          body;
+
+    m_response = ss.str();
+
+    boost::asio::async_write(
+                m_socket,
+                boost::asio::buffer(m_response),
+                boost::bind(
+                    &Connection::onWritten,
+                    shared_from_this(),
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred));
+}
+
+// ============================================================ //
+
+void MetricsExporter::Connection::onWritten(const boost::system::error_code &, size_t)
+{
+    boost::system::error_code ec;
+
+    m_timer.cancel(ec);
+
+    m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+
+    m_socket.close(ec);
+}
+
+// ============================================================ //
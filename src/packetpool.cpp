@@ -0,0 +1,317 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "packetpool.h"
+
+// ============================================================ //
+// PacketPool
+// ============================================================ //
+
+Zway::PACKET PacketPool::createPacket()
+{
+    return Pools::local().acquirePacket();
+}
+
+// ============================================================ //
+
+Zway::BUFFER PacketPool::createBuffer(size_t size)
+{
+    if (size == 0 || size > Zway::MAX_PACKET_BODY) {
+
+        return Zway::Buffer::create(nullptr, size);
+    }
+
+    return Pools::local().acquireBuffer(size);
+}
+
+// ============================================================ //
+
+PacketPool::Stats PacketPool::packetStats()
+{
+    Stats stats;
+
+    Pools::visit([&stats] (PacketPool &pool) {
+
+        pool.m_packetCounters.merge(stats);
+    });
+
+    return stats;
+}
+
+// ============================================================ //
+
+PacketPool::Stats PacketPool::bufferStats()
+{
+    Stats stats;
+
+    Pools::visit([&stats] (PacketPool &pool) {
+
+        pool.m_bufferCounters.merge(stats);
+    });
+
+    return stats;
+}
+
+// ============================================================ //
+
+PacketPool::PacketPool()
+    : m_bufferBytes(0),
+      m_bufferClock(0)
+{
+
+}
+
+// ============================================================ //
+
+Zway::PACKET PacketPool::acquirePacket()
+{
+    Zway::PACKET pkt;
+
+    {
+        boost::mutex::scoped_lock locker(m_mutex);
+
+        if (!m_packets.empty()) {
+
+            pkt = m_packets.back();
+
+            m_packets.pop_back();
+        }
+    }
+
+    m_packetCounters.acquire(pkt != nullptr);
+
+    if (!pkt) {
+
+        pkt = Zway::Packet::create();
+
+        if (!pkt) {
+
+            m_packetCounters.release();
+
+            return nullptr;
+        }
+    }
+
+    return Zway::PACKET(pkt.get(), Recycler<Zway::Packet>(shared_from_this(), pkt));
+}
+
+// ============================================================ //
+
+Zway::BUFFER PacketPool::acquireBuffer(size_t size)
+{
+    Zway::BUFFER buf;
+
+    {
+        boost::mutex::scoped_lock locker(m_mutex);
+
+        auto it = m_buffers.find(size);
+
+        if (it != m_buffers.end() && !it->second.buffers.empty()) {
+
+            buf = it->second.buffers.back();
+
+            it->second.buffers.pop_back();
+
+            it->second.lastUse = ++m_bufferClock;
+
+            m_bufferBytes -= size;
+        }
+    }
+
+    m_bufferCounters.acquire(buf != nullptr);
+
+    if (!buf) {
+
+        buf = Zway::Buffer::create(nullptr, size);
+
+        if (!buf) {
+
+            m_bufferCounters.release();
+
+            return nullptr;
+        }
+    }
+
+    return Zway::BUFFER(buf.get(), Recycler<Zway::Buffer>(shared_from_this(), buf));
+}
+
+// ============================================================ //
+
+void PacketPool::recycle(const Zway::PACKET &pkt)
+{
+    m_packetCounters.release();
+
+    // drop the body, so it returns to its own pool
+
+    pkt->setBody(nullptr);
+
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    if (m_packets.size() < PACKET_POOL_MAX_PACKETS) {
+
+        m_packets.push_back(pkt);
+    }
+}
+
+// ============================================================ //
+
+void PacketPool::recycle(const Zway::BUFFER &buf)
+{
+    m_bufferCounters.release();
+
+    size_t size = buf->size();
+
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    auto it = m_buffers.find(size);
+
+    if (it == m_buffers.end()) {
+
+        if (m_buffers.size() >= PACKET_POOL_MAX_CLASSES && !evictBuffers(size)) {
+
+            return;
+        }
+
+        it = m_buffers.insert(std::make_pair(size, BufferClass())).first;
+    }
+
+    it->second.lastUse = ++m_bufferClock;
+
+    if (it->second.buffers.size() >= PACKET_POOL_MAX_BUFFERS) {
+
+        return;
+    }
+
+    while (m_bufferBytes + size > PACKET_POOL_MAX_BYTES) {
+
+        if (!evictBuffers(size)) {
+
+            return;
+        }
+    }
+
+    it->second.buffers.push_back(buf);
+
+    m_bufferBytes += size;
+}
+
+// ============================================================ //
+
+bool PacketPool::evictBuffers(size_t keep)
+{
+    // drop the least recently used size class other than keep,
+    // the caller holds m_mutex
+
+    auto cold = m_buffers.end();
+
+    for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+
+        if (it->first != keep && (cold == m_buffers.end() || it->second.lastUse < cold->second.lastUse)) {
+
+            cold = it;
+        }
+    }
+
+    if (cold == m_buffers.end()) {
+
+        return false;
+    }
+
+    m_bufferBytes -= cold->first * cold->second.buffers.size();
+
+    m_buffers.erase(cold);
+
+    return true;
+}
+
+// ============================================================ //
+// PacketPool::Stats
+// ============================================================ //
+
+PacketPool::Stats::Stats()
+    : hits(0),
+      misses(0),
+      inUse(0),
+      highWater(0)
+{
+
+}
+
+// ============================================================ //
+// PacketPool::Counters
+// ============================================================ //
+
+PacketPool::Counters::Counters()
+    : hits(0),
+      misses(0),
+      inUse(0),
+      highWater(0)
+{
+
+}
+
+void PacketPool::Counters::acquire(bool hit)
+{
+    if (hit) {
+
+        hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+
+        misses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t n = inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    uint64_t hw = highWater.load(std::memory_order_relaxed);
+
+    while (n > hw && !highWater.compare_exchange_weak(hw, n, std::memory_order_relaxed)) {
+    }
+}
+
+void PacketPool::Counters::release()
+{
+    inUse.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void PacketPool::Counters::merge(Stats &stats)
+{
+    // per-thread high-water marks are summed up,
+    // which is an upper bound for the total
+
+    stats.hits += hits.load(std::memory_order_relaxed);
+
+    stats.misses += misses.load(std::memory_order_relaxed);
+
+    stats.inUse += inUse.load(std::memory_order_relaxed);
+
+    stats.highWater += highWater.load(std::memory_order_relaxed);
+}
+
+// ============================================================ //
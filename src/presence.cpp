@@ -0,0 +1,248 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "presence.h"
+
+#include <algorithm>
+
+// ============================================================ //
+// Presence
+// ============================================================ //
+
+Presence::Entry::Entry()
+    : sessions(0),
+      visible(0)
+{
+
+}
+
+// ============================================================ //
+
+Presence::Presence()
+{
+
+}
+
+// ============================================================ //
+
+void Presence::attach(uint32_t accountId)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::unique_lock<boost::shared_mutex> locker(s.mutex);
+
+    s.map[accountId].sessions++;
+}
+
+// ============================================================ //
+
+void Presence::detach(uint32_t accountId)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::unique_lock<boost::shared_mutex> locker(s.mutex);
+
+    auto it = s.map.find(accountId);
+
+    if (it == s.map.end()) {
+
+        return;
+    }
+
+    if (it->second.sessions) {
+
+        it->second.sessions--;
+    }
+
+    if (!it->second.sessions) {
+
+        it->second.audience.clear();
+    }
+
+    release(s, it);
+}
+
+// ============================================================ //
+
+bool Presence::setVisible(uint32_t accountId, bool visible)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::unique_lock<boost::shared_mutex> locker(s.mutex);
+
+    Entry &entry = s.map[accountId];
+
+    if (visible) {
+
+        return ++entry.visible == 1;
+    }
+
+    if (!entry.visible) {
+
+        return false;
+    }
+
+    return --entry.visible == 0;
+}
+
+// ============================================================ //
+
+void Presence::setAudience(uint32_t accountId, const std::set<uint32_t> &audience)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::unique_lock<boost::shared_mutex> locker(s.mutex);
+
+    s.map[accountId].audience = audience;
+}
+
+// ============================================================ //
+
+void Presence::addAudience(uint32_t accountId, uint32_t contactId)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::unique_lock<boost::shared_mutex> locker(s.mutex);
+
+    s.map[accountId].audience.insert(contactId);
+}
+
+// ============================================================ //
+
+void Presence::subscribe(const CLIENT_SESSION &session, const std::set<uint32_t> &accountIds)
+{
+    subscribe(session, session->accountId(), accountIds);
+}
+
+// ============================================================ //
+
+void Presence::subscribe(const CLIENT_SESSION &session, uint32_t watcherId, const std::set<uint32_t> &accountIds)
+{
+    for (uint32_t accountId : accountIds) {
+
+        Shard &s = m_shards.shard(accountId);
+
+        boost::unique_lock<boost::shared_mutex> locker(s.mutex);
+
+        s.map[accountId].watchers[session] = watcherId;
+    }
+}
+
+// ============================================================ //
+
+void Presence::unsubscribe(const CLIENT_SESSION &session, const std::set<uint32_t> &accountIds)
+{
+    for (uint32_t accountId : accountIds) {
+
+        Shard &s = m_shards.shard(accountId);
+
+        boost::unique_lock<boost::shared_mutex> locker(s.mutex);
+
+        auto it = s.map.find(accountId);
+
+        if (it != s.map.end()) {
+
+            it->second.watchers.erase(session);
+
+            release(s, it);
+        }
+    }
+}
+
+// ============================================================ //
+
+uint32_t Presence::status(uint32_t accountId)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::shared_lock<boost::shared_mutex> locker(s.mutex);
+
+    auto it = s.map.find(accountId);
+
+    if (it != s.map.end() && it->second.visible) {
+
+        return 1;
+    }
+
+    return 0;
+}
+
+// ============================================================ //
+
+std::vector<uint32_t> Presence::status(const std::vector<uint32_t> &accountIds)
+{
+    std::vector<uint32_t> res(accountIds.size(), 0);
+
+    // group the lookups by shard
+
+    std::vector<size_t> order(accountIds.size());
+
+    for (size_t i=0; i<order.size(); ++i) {
+
+        order[i] = i;
+    }
+
+    std::sort(order.begin(), order.end(), [&accountIds] (size_t a, size_t b) {
+
+        return Shards::index(accountIds[a]) < Shards::index(accountIds[b]);
+    });
+
+    for (size_t i=0; i<order.size(); ) {
+
+        Shard &s = m_shards.shard(accountIds[order[i]]);
+
+        boost::shared_lock<boost::shared_mutex> locker(s.mutex);
+
+        for (; i<order.size() && &m_shards.shard(accountIds[order[i]]) == &s; ++i) {
+
+            auto it = s.map.find(accountIds[order[i]]);
+
+            if (it != s.map.end() && it->second.visible) {
+
+                res[order[i]] = 1;
+            }
+        }
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+void Presence::release(Shard &s, Shard::Map::iterator it)
+{
+    // called with the shard locked exclusively
+
+    if (!it->second.sessions && !it->second.visible && it->second.watchers.empty()) {
+
+        s.map.erase(it);
+    }
+}
+
+// ============================================================ //
@@ -0,0 +1,152 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "requestcounters.h"
+
+#include "Zway/core/request.h"
+
+// ============================================================ //
+
+RequestCounters::Shards RequestCounters::m_shards;
+
+// ============================================================ //
+// RequestCounters
+// ============================================================ //
+
+RequestCounters::Counts::Counts()
+    : contactRequests(0),
+      pushRequests(0)
+{
+
+}
+
+// ============================================================ //
+
+void RequestCounters::add(uint32_t accountId, uint32_t type)
+{
+    Counts counts;
+
+    if (!counter(counts, type)) {
+
+        return;
+    }
+
+    Shard &s = m_shards.shard(accountId);
+
+    boost::mutex::scoped_lock locker(s.mutex);
+
+    (*counter(s.map[accountId], type))++;
+}
+
+// ============================================================ //
+
+void RequestCounters::remove(uint32_t accountId, uint32_t type)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::mutex::scoped_lock locker(s.mutex);
+
+    auto it = s.map.find(accountId);
+
+    if (it == s.map.end()) {
+
+        return;
+    }
+
+    uint32_t *c = counter(it->second, type);
+
+    if (c && *c > 0) {
+
+        (*c)--;
+    }
+
+    if (!it->second.contactRequests && !it->second.pushRequests) {
+
+        s.map.erase(it);
+    }
+}
+
+// ============================================================ //
+
+RequestCounters::Counts RequestCounters::get(uint32_t accountId)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::mutex::scoped_lock locker(s.mutex);
+
+    auto it = s.map.find(accountId);
+
+    if (it != s.map.end()) {
+
+        return it->second;
+    }
+
+    return Counts();
+}
+
+// ============================================================ //
+
+void RequestCounters::load(const Map &counts)
+{
+    for (Shard &s : m_shards) {
+
+        boost::mutex::scoped_lock locker(s.mutex);
+
+        s.map.clear();
+    }
+
+    for (auto &it : counts) {
+
+        Shard &s = m_shards.shard(it.first);
+
+        boost::mutex::scoped_lock locker(s.mutex);
+
+        s.map[it.first] = it.second;
+    }
+}
+
+// ============================================================ //
+
+uint32_t *RequestCounters::counter(Counts &counts, uint32_t type)
+{
+    switch (type) {
+
+        case Zway::Request::AddContact:
+
+            return &counts.contactRequests;
+
+        case Zway::Request::Push:
+
+            return &counts.pushRequests;
+    }
+
+    return nullptr;
+}
+
+// ============================================================ //
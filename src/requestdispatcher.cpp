@@ -0,0 +1,173 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "requestdispatcher.h"
+#include "session.h"
+#include "logger.h"
+
+// ============================================================ //
+
+std::map<uint32_t, RequestDispatcher::Entry> RequestDispatcher::m_handlers;
+
+// ============================================================ //
+// RequestDispatcher
+// ============================================================ //
+
+RequestDispatcher::Stats::Stats()
+    : type(0),
+      success(0),
+      failure(0)
+{
+
+}
+
+// ============================================================ //
+
+RequestDispatcher::Counters::Counters()
+    : success(0),
+      failure(0),
+      latency(Histogram::create())
+{
+
+}
+
+// ============================================================ //
+
+bool RequestDispatcher::add(uint32_t type, const std::string &name, Handler handler)
+{
+    auto it = m_handlers.find(type);
+
+    if (it != m_handlers.end()) {
+
+        it->second.name = name;
+
+        it->second.handler = handler;
+
+        return true;
+    }
+
+    if (m_handlers.size() >= REQUEST_DISPATCHER_MAX_TYPES) {
+
+        LOG_ERROR << "Too many request types, " << name << " not registered";
+
+        return false;
+    }
+
+    m_handlers[type] = Entry{(uint32_t)m_handlers.size(), name, handler};
+
+    return true;
+}
+
+// ============================================================ //
+
+bool RequestDispatcher::has(uint32_t type)
+{
+    return m_handlers.find(type) != m_handlers.end();
+}
+
+// ============================================================ //
+
+bool RequestDispatcher::dispatch(ClientSession *session, uint32_t type, const Zway::UBJ::Object &request)
+{
+    auto it = m_handlers.find(type);
+
+    if (it == m_handlers.end()) {
+
+        return false;
+    }
+
+    return (session->*(it->second.handler))(request);
+}
+
+// ============================================================ //
+
+void RequestDispatcher::record(uint32_t type, uint64_t latency, bool success)
+{
+    auto it = m_handlers.find(type);
+
+    if (it == m_handlers.end()) {
+
+        return;
+    }
+
+    Counters &counters = Blocks::local().counters[it->second.slot];
+
+    if (success) {
+
+        counters.success++;
+    }
+    else {
+
+        counters.failure++;
+    }
+
+    counters.latency->record(latency);
+}
+
+// ============================================================ //
+
+std::vector<RequestDispatcher::Stats> RequestDispatcher::stats()
+{
+    std::vector<Stats> res;
+
+    for (auto &it : m_handlers) {
+
+        Stats stats;
+
+        stats.type = it.first;
+
+        stats.name = it.second.name;
+
+        stats.latency = Histogram::create();
+
+        res.push_back(stats);
+    }
+
+    Blocks::visit([&res] (ThreadStats &ts) {
+
+        size_t i = 0;
+
+        for (auto &it : m_handlers) {
+
+            Counters &counters = ts.counters[it.second.slot];
+
+            res[i].success += counters.success;
+
+            res[i].failure += counters.failure;
+
+            res[i].latency->merge(*counters.latency);
+
+            i++;
+        }
+    });
+
+    return res;
+}
+
+// ============================================================ //
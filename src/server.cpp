@@ -29,37 +29,106 @@
 
 #include "logger.h"
 #include "server.h"
+#include "metrics.h"
+#include "packetpool.h"
+#include "requestdispatcher.h"
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <unordered_set>
+
+// ============================================================ //
+
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+
+// ============================================================ //
+
+Server::Options::Options()
+    : numAcceptors(NUM_ACCEPTORS),
+      pendingAccepts(NUM_PENDING_ACCEPTS),
+      sendBatchBytes(SEND_BATCH_BYTES),
+      sendBatchPackets(SEND_BATCH_PACKETS),
+      sendQueueLowWatermark(SEND_QUEUE_LOW_WATERMARK),
+      sendQueueHighWatermark(SEND_QUEUE_HIGH_WATERMARK),
+      sendQueueHardLimit(SEND_QUEUE_HARD_LIMIT),
+      bulkShare(BULK_MIN_SHARE),
+      tlsCacheSize(TLS_SESSION_CACHE_SIZE),
+      tlsTicketLifetime(TLS_TICKET_LIFETIME),
+      dbMinConnections(DB_MIN_CONNECTIONS),
+      dbMaxConnections(DB_MAX_CONNECTIONS),
+      dbAcquireTimeout(DB_ACQUIRE_TIMEOUT),
+      dbIdleTimeout(DB_IDLE_TIMEOUT),
+      accountCacheSize(ACCOUNT_CACHE_SIZE),
+      accountCacheTtl(ACCOUNT_CACHE_TTL),
+      metricsPort(METRICS_PORT)
+{
+}
+
 // ============================================================ //
 
-Server::Server(boost::shared_ptr<boost::asio::io_service> io_service)
+Server::Server(IO_SERVICE_POOL ioPool)
     : m_paused(false),
       m_numSessions(0),
-      m_io_service(io_service),
-      m_timer(*io_service),
-      m_context(*io_service, boost::asio::ssl::context::tlsv12_server),
-      m_acceptor(*io_service)
+      m_ioPool(ioPool),
+      m_io_service(ioPool->shard(0)->io_service_ptr()),
+      m_timer(*m_io_service),
+      m_context(*m_io_service, boost::asio::ssl::context::tlsv12_server),
+      m_buffers(LockName("Server::m_buffers")),
+      m_senders(LockName("Server::m_senders"))
 {
+    // one heartbeat wheel per shard, ticking on the shard's thread
+
+    for (uint32_t i=0; i<m_ioPool->size(); ++i) {
+
+        m_timerWheels.push_back(TimerWheel::create(m_ioPool->shard(i)->io_service(), HEARTBEAT_TIMEOUT));
+    }
 }
 
 // ============================================================ //
 
-bool Server::start(const std::string &workingDir, const std::string& address, uint32_t port)
+bool Server::start(const std::string &workingDir, const std::string& address, uint32_t port, const Options &options)
 {
-    // init database connection
+    m_options = options;
+
+    m_options.numAcceptors = std::max<uint32_t>(1, m_options.numAcceptors);
+
+    m_options.pendingAccepts = std::max<uint32_t>(1, m_options.pendingAccepts);
 
-    // TODO: we need a pool of db clients, due to the fact
-    // one client instance should only be used by
-    // one single thread (semaphore?)
+    m_options.sendBatchPackets = std::max<uint32_t>(1, m_options.sendBatchPackets);
 
-    if (!DB::startup("127.0.0.1", 25)) {
+    m_options.sendQueueHighWatermark = std::max(m_options.sendQueueHighWatermark, m_options.sendQueueLowWatermark);
+
+    m_options.sendQueueHardLimit = std::max(m_options.sendQueueHardLimit, m_options.sendQueueHighWatermark);
+
+    m_options.bulkShare = std::min<uint32_t>(100, m_options.bulkShare);
+
+    ClientSession::registerRequestHandlers();
+
+    AccountCache::startup(m_options.accountCacheSize, m_options.accountCacheTtl);
+
+    // init database connection pool
+
+    DB::PoolOptions poolOptions;
+
+    poolOptions.minConnections = m_options.dbMinConnections;
+
+    poolOptions.maxConnections = m_options.dbMaxConnections;
+
+    poolOptions.acquireTimeout = m_options.dbAcquireTimeout;
+
+    poolOptions.idleTimeout = m_options.dbIdleTimeout;
+
+    if (!DB::startup("127.0.0.1", poolOptions)) {
 
         return false;
     }
 
-    // init acceptor socket
+    if (!DB::loadRequestCounters()) {
+
+        return false;
+    }
+
+    // init tls context and resolve endpoint
 
     try {
 
@@ -75,25 +144,24 @@ bool Server::start(const std::string &workingDir, const std::string& address, ui
 
         m_context.use_private_key_file(certsDir + "/x509-server-key.pem", boost::asio::ssl::context::pem);
 
+        if (!TlsSessionCache::startup(m_context.native_handle(), m_options.tlsCacheSize, m_options.tlsTicketLifetime)) {
+
+            LOG_ERROR << "Failed to init tls session cache";
+
+            return false;
+        }
+
         // TODO set dh params file here IMPORTANT
 
         using namespace boost::asio::ip;
 
-        tcp::resolver resolver(m_acceptor.get_io_service());
+        tcp::resolver resolver(*m_io_service);
 
         tcp::resolver::query query(tcp::v4(), address, boost::lexical_cast<std::string>(port));
 
         tcp::resolver::iterator iterator = resolver.resolve(query);
 
         m_endpoint = *iterator;
-
-        m_acceptor.open(tcp::v4());
-
-        m_acceptor.set_option(tcp::acceptor::reuse_address(true));
-
-        m_acceptor.bind(m_endpoint);
-
-        m_acceptor.listen();
     }
     catch (std::exception& e) {
 
@@ -102,6 +170,13 @@ bool Server::start(const std::string &workingDir, const std::string& address, ui
         return false;
     }
 
+    // init acceptor sockets
+
+    if (!listen()) {
+
+        return false;
+    }
+
     m_timer.expires_from_now(boost::posix_time::milliseconds(2000));
 
     m_timer.async_wait(
@@ -110,13 +185,49 @@ bool Server::start(const std::string &workingDir, const std::string& address, ui
                     this,
                     boost::asio::placeholders::error));
 
+    for (TIMER_WHEEL &wheel : m_timerWheels) {
+
+        wheel->start();
+    }
+
+    // metrics endpoint, failing to bind it is not fatal
+
+    if (m_options.metricsPort) {
+
+        m_metricsExporter = MetricsExporter::create();
+
+        m_metricsExporter->addHandler("/metrics", [this] (const std::string &) {
+
+            return metrics();
+        });
+
+        m_metricsExporter->addHandler("/status", [this] (const std::string &query) {
+
+            return snapshot()->format(query);
+        });
+
+#ifdef ZWAY_LOCK_PROFILING
+        m_metricsExporter->addHandler("/locks", [] (const std::string &) {
+
+            return LockProfiler::report();
+        });
+#endif
+
+        if (!m_metricsExporter->start("127.0.0.1", m_options.metricsPort)) {
+
+            m_metricsExporter.reset();
+        }
+    }
+
     // start serving clients
 
     m_startTime = boost::posix_time::second_clock::local_time();
 
-    accept();
+#ifdef ZWAY_LOCK_PROFILING
+    m_lockReportTime = m_startTime;
+#endif
 
-    LOG_INFO << "server started";
+    LOG_INFO << "server started, " << m_acceptors.size() << " acceptor(s)";
 
     return true;
 }
@@ -129,9 +240,21 @@ void Server::close()
 
     m_timer.cancel(ec);
 
-    // close acceptor socket
+    for (TIMER_WHEEL &wheel : m_timerWheels) {
+
+        wheel->stop();
+    }
+
+    // close acceptor sockets
+
+    closeAcceptors();
 
-    m_acceptor.close(ec);
+    if (m_metricsExporter) {
+
+        m_metricsExporter->stop();
+
+        m_metricsExporter.reset();
+    }
 
     // close remaining sessions
 
@@ -160,18 +283,9 @@ bool Server::pause()
         return false;
     }
 
-    try {
-
-        m_acceptor.close();
-
-        m_paused = true;
-    }
-    catch (std::exception& e) {
-
-        LOG_ERROR << e.what();
+    closeAcceptors();
 
-        return false;
-    }
+    m_paused = true;
 
     return true;
 }
@@ -184,27 +298,13 @@ bool Server::resume()
         return false;
     }
 
-    try {
-
-        m_acceptor.open(boost::asio::ip::tcp::v4());
-
-        //m_acceptor.set_option(tcp::acceptor::reuse_address(true));
-
-        m_acceptor.bind(m_endpoint);
-
-        m_acceptor.listen();
-
-        accept();
-
-        m_paused = false;
-    }
-    catch (std::exception& e) {
-
-        LOG_ERROR << e.what();
+    if (!listen()) {
 
         return false;
     }
 
+    m_paused = false;
+
     return true;
 }
 
@@ -212,53 +312,39 @@ bool Server::resume()
 
 void Server::appendSession(CLIENT_SESSION session)
 {
-	boost::mutex::scoped_lock l(m_sessions);
-
-    ((*m_sessions)[session->accountId()]).push_back(session);
+    m_sessions.append(session);
 }
 
 // ============================================================ //
 
 void Server::removeSession(CLIENT_SESSION session)
 {
-    boost::mutex::scoped_lock l(m_sessions);
-
-    uint32_t accountId = session->accountId();
-
-    if (m_sessions->find(accountId) != m_sessions->end()) {
-
-        CLIENT_SESSION_LIST& sm = (*m_sessions)[accountId];
-
-        sm.remove(session);
+    m_sessions.remove(session);
+}
 
-        if (sm.empty()) {
+// ============================================================ //
 
-            m_sessions->erase(accountId);
-        }
-    }
+Presence &Server::presence()
+{
+    return m_presence;
 }
 
 // ============================================================ //
 
 void Server::removeSessions()
 {
-    boost::mutex::scoped_lock l(m_sessions);
-
-    if (!m_sessions->empty()) {
+    CLIENT_SESSION_LIST sessions = m_sessions.removeAll();
 
-        LOG_INFO << "Disconnecting " << m_sessions->size() << " users";
+    if (!sessions.empty()) {
 
-        for (auto &it : (*m_sessions)) {
+        LOG_INFO << "Disconnecting " << sessions.size() << " sessions";
 
-            for (auto &s : it.second) {
+        for (auto &s : sessions) {
 
-                // TODO shutdown connection properly/gracefully
+            // TODO shutdown connection properly/gracefully
 
-                s->close(false, false);
-            }
+            s->execute(boost::bind(&ClientSession::close, s, false, false));
         }
-
-        m_sessions->clear();
     }
 }
 
@@ -266,76 +352,98 @@ void Server::removeSessions()
 
 size_t Server::getSessionCount()
 {
-	boost::mutex::scoped_lock l(m_sessions);
-
-    return m_sessions->size();
+    return m_sessions.size();
 }
 
 // ============================================================ //
 
-CLIENT_SESSION_LIST Server::getSessions(uint32_t userId)
+void Server::processUserRequests(uint32_t userId)
 {
-	boost::mutex::scoped_lock l(m_sessions);
-
-    CLIENT_SESSION_LIST res;
-
-    if (m_sessions->find(userId) != m_sessions->end()) {
-
-        res = (*m_sessions)[userId];
-    }
-
-    return res;
+    processUsersRequests(std::vector<uint32_t>(1, userId));
 }
 
 // ============================================================ //
 
-void Server::processUserRequests(uint32_t userId)
+void Server::processUsersRequests(const std::vector<uint32_t> &userIds)
 {
-    CLIENT_SESSION_LIST sessions = getSessions(userId);
+    std::vector<uint32_t> offline;
 
-    if (!sessions.empty()) {
+    for (uint32_t userId : userIds) {
 
-        for (auto &s : sessions) {
+        size_t numSessions = m_sessions.visit(userId, [] (const CLIENT_SESSION &s) {
+
+            s->execute(boost::bind(&ClientSession::processRequests, s));
+        });
 
-            s->processRequests();
+        if (!numSessions) {
+
+            offline.push_back(userId);
         }
     }
-    else {
 
-        std::string fcmToken = DB::getFcmToken(userId);
+    if (offline.empty()) {
+
+        return;
+    }
+
+    // notify offline users, the db executor only looks up the
+    // notification info and hands the messages to the fcm executor
 
-        if (!fcmToken.empty()) {
+    DB::post([offline] () {
 
-            uint32_t numContactRequests = DB::numContactRequests(userId);
+        std::vector<DB::NotificationInfo> infos;
 
-            if (numContactRequests > 0) {
+        for (uint32_t userId : offline) {
 
-                FcmSender::sendMessage(fcmToken, 1000, numContactRequests);
+            DB::NotificationInfo info;
+
+            if (DB::getNotificationInfo(userId, info)) {
+
+                infos.push_back(info);
             }
+        }
 
-            uint32_t numMessages = DB::numPushRequests(userId);
+        for (const DB::NotificationInfo &info : infos) {
 
-            if (numMessages > 0) {
+            if (info.numContactRequests > 0) {
 
-                FcmSender::sendMessage(fcmToken, 2000, numMessages);
+                FcmSender::post(info.fcmToken, 1000, info.numContactRequests);
+            }
+
+            if (info.numPushRequests > 0) {
+
+                FcmSender::post(info.fcmToken, 2000, info.numPushRequests);
             }
         }
-    }
+    });
 }
 
 // ============================================================ //
 
 bool Server::addStreamBuffer(STREAM_BUFFER buffer)
 {
-    boost::mutex::scoped_lock locker(m_buffers);
+    ThreadSafeMutex::scoped_lock locker(m_buffers);
 
     if (m_buffers->find(buffer->streamId()) != m_buffers->end()) {
 
         return false;
     }
 
+    // before the buffer is published, writes read the handler unlocked
+
+    buffer->setWriteHandler([this] (uint32_t id) {
+
+        notifyStreamBufferSenders(id);
+    });
+
     (*m_buffers)[buffer->streamId()] = buffer;
 
+    locker.unlock();
+
+    // senders may have been added before the upload started
+
+    notifyStreamBufferSenders(buffer->streamId());
+
     return true;
 }
 
@@ -343,7 +451,7 @@ bool Server::addStreamBuffer(STREAM_BUFFER buffer)
 
 bool Server::removeStreamBuffer(uint32_t id)
 {
-    boost::mutex::scoped_lock locker(m_buffers);
+    ThreadSafeMutex::scoped_lock locker(m_buffers);
 
     if (m_buffers->find(id) == m_buffers->end()) {
 
@@ -359,7 +467,7 @@ bool Server::removeStreamBuffer(uint32_t id)
 
 STREAM_BUFFER Server::getStreamBuffer(uint32_t id)
 {
-    boost::mutex::scoped_lock locker(m_buffers);
+    ThreadSafeMutex::scoped_lock locker(m_buffers);
 
     if (m_buffers->find(id) != m_buffers->end()) {
 
@@ -388,55 +496,469 @@ STREAM_BUFFER Server::getStreamBuffer(uint32_t id)
 
 void Server::addStreamBufferSender(STREAM_BUFFER_SENDER sender)
 {
-    boost::mutex::scoped_lock locker(m_senders);
+    {
+        ThreadSafeMutex::scoped_lock locker(m_senders);
+
+        (*m_senders)[sender->id()].push_back(sender);
+    }
+
+    // send what is already buffered, further
+    // chunks are pushed as soon as they arrive
 
-    m_senders->push_back(sender);
+    CLIENT_SESSION session = sender->session();
+
+    session->execute(boost::bind(&ClientSession::sendPacket, session));
+}
+
+// ============================================================ //
+
+void Server::removeStreamBufferSender(StreamBufferSender *sender)
+{
+    ThreadSafeMutex::scoped_lock locker(m_senders);
+
+    auto it = m_senders->find(sender->id());
+
+    if (it == m_senders->end()) {
+
+        return;
+    }
+
+    it->second.remove_if([sender] (const STREAM_BUFFER_SENDER &s) {
+
+        return s.get() == sender;
+    });
+
+    if (it->second.empty()) {
+
+        m_senders->erase(it);
+    }
+}
+
+// ============================================================ //
+
+void Server::removeStreamBufferSenders(uint32_t id)
+{
+    ThreadSafeMutex::scoped_lock locker(m_senders);
+
+    m_senders->erase(id);
+}
+
+// ============================================================ //
+
+void Server::removeStreamBufferSenders(ClientSession *session)
+{
+    ThreadSafeMutex::scoped_lock locker(m_senders);
+
+    for (auto it = m_senders->begin(); it != m_senders->end(); ) {
+
+        it->second.remove_if([session] (const STREAM_BUFFER_SENDER &s) {
+
+            return s->session().get() == session;
+        });
+
+        if (it->second.empty()) {
+
+            it = m_senders->erase(it);
+        }
+        else {
+
+            ++it;
+        }
+    }
+}
+
+// ============================================================ //
+
+void Server::notifyStreamBufferSenders(uint32_t id)
+{
+    ThreadSafeMutex::scoped_lock locker(m_senders);
+
+    auto it = m_senders->find(id);
+
+    if (it == m_senders->end()) {
+
+        return;
+    }
+
+    std::list<STREAM_BUFFER_SENDER> &senders = it->second;
+
+    for (auto s = senders.begin(); s != senders.end(); ) {
+
+        CLIENT_SESSION session = (*s)->session();
+
+        // drop senders that are done or whose session is gone
+
+        if ((*s)->status() == StreamBufferSender::Completed || session->status() == STATUS_DISCONNECTED) {
+
+            s = senders.erase(s);
+
+            continue;
+        }
+
+        session->execute(boost::bind(&ClientSession::sendPacket, session));
+
+        ++s;
+    }
+
+    if (senders.empty()) {
+
+        m_senders->erase(it);
+    }
 }
 
 // ============================================================ //
 
 size_t Server::numStreamBuffers()
 {
-    boost::mutex::scoped_lock lock(m_buffers);
+    ThreadSafeMutex::scoped_lock lock(m_buffers);
 
     return m_buffers->size();
 }
 
 // ============================================================ //
 
-void Server::info()
+STATUS_SNAPSHOT Server::snapshot()
 {
-    std::string sessionList;
+    STATUS_SNAPSHOT snapshot = StatusSnapshot::create();
 
-    boost::mutex::scoped_lock locker(m_sessions);
+    // only cached per session values are read, the registry
+    // lock is held just for the copy
 
-    for (auto &it : (*m_sessions)) {
+    CLIENT_SESSION_LIST sessions;
 
-        for (auto &s : it.second) {
+    m_sessions.visitAll([&sessions] (const CLIENT_SESSION &s) {
 
-            std::stringstream ss;
+        sessions.push_back(s);
+    });
 
-            mongo::BSONObj account;
+    snapshot->sessions.reserve(sessions.size());
 
-            if (DB::getAccount(BSON("id" << s->accountId()), BSON("name" << 1), account)) {
+    for (auto &s : sessions) {
 
-                ss << s->remoteHost() << "\t" << account["name"].str() << "\n";
-            }
-            else {
+        StatusSnapshot::Session info;
 
-                ss << s->remoteHost() << "\t?\n";
-            }
+        info.remoteHost = s->remoteHost();
+
+        info.accountId = s->accountId();
+
+        info.accountName = s->accountName();
+
+        info.numPacketsSent = s->numPacketsSent();
+
+        info.numWritesSent = s->numWritesSent();
+
+        info.queuedPackets = s->queuedPackets();
+
+        info.queuedBytes = s->queuedBytes();
+
+        snapshot->sessions.push_back(info);
+    }
+
+    std::stringstream lanes;
+
+    const char *laneNames[ClientSession::NumLanes] = {"control", "bulk"};
+
+    for (uint32_t i=0; i<ClientSession::NumLanes; ++i) {
+
+        HISTOGRAM latency = laneLatency(i);
+
+        lanes << "Lane " << laneNames[i] << ": packets " << latency->count() <<
+                 ", p50 " << latency->percentile(0.5) << "us" <<
+                 ", p99 " << latency->percentile(0.99) << "us" <<
+                 ", max " << latency->max() << "us\n";
+    }
+
+    std::stringstream requests;
+
+    for (RequestDispatcher::Stats &stats : RequestDispatcher::stats()) {
+
+        if (!stats.success && !stats.failure) {
+
+            continue;
+        }
+
+        requests << "Request " << stats.name << ": ok " << stats.success << ", failed " << stats.failure <<
+                    ", p50 " << stats.latency->percentile(0.5) << "us" <<
+                    ", p99 " << stats.latency->percentile(0.99) << "us" <<
+                    ", max " << stats.latency->max() << "us\n";
+    }
+
+    PacketPool::Stats packetStats = PacketPool::packetStats();
+
+    PacketPool::Stats bufferStats = PacketPool::bufferStats();
+
+    std::stringstream ss;
+
+    ss << "Status info:\n" <<
+          "Duration: " << uptimeStr() << "\n" <<
+          "Stream buffers: " << numStreamBuffers() << "\n" <<
+          "TLS handshakes: resumed " << TlsSessionCache::numResumedHandshakes() <<
+          ", full " << TlsSessionCache::numFullHandshakes() << "\n" <<
+          "Packet pool: hits " << packetStats.hits << ", misses " << packetStats.misses <<
+          ", in use " << packetStats.inUse << ", high-water " << packetStats.highWater << "\n" <<
+          "Buffer pool: hits " << bufferStats.hits << ", misses " << bufferStats.misses <<
+          ", in use " << bufferStats.inUse << ", high-water " << bufferStats.highWater << "\n" <<
+          "Account cache: hits " << Metrics::counter(Metrics::AccountCacheHits) <<
+          ", misses " << Metrics::counter(Metrics::AccountCacheMisses) <<
+          ", entries " << AccountCache::size() << "\n" <<
+          lanes.str() <<
+          requests.str();
+
+    snapshot->summary = ss.str();
+
+    return snapshot;
+}
+
+// ============================================================ //
+
+void Server::info(uint32_t offset, uint32_t limit)
+{
+    LOG_INFO << snapshot()->format(offset, limit);
+}
+
+// ============================================================ //
+
+std::string Server::metrics()
+{
+    std::stringstream ss;
+
+    // sessions
+
+    uint32_t numOpen = 0;
+
+    for (uint32_t i=0; i<m_ioPool->size(); ++i) {
+
+        numOpen += m_ioPool->shard(i)->load();
+    }
+
+    uint64_t queuedBytes = 0;
+
+    // sessions that did not log in yet are registered
+    // under a temporary id, they are no online account
+
+    std::unordered_set<uint32_t> accountsOnline;
+
+    m_sessions.visitAll([&queuedBytes, &accountsOnline] (const CLIENT_SESSION &s) {
+
+        queuedBytes += s->queuedBytes();
+
+        if (s->status() == STATUS_LOGGEDIN) {
+
+            accountsOnline.insert(s->accountId());
+        }
+    });
+
+    MetricsExporter::writeHeader(ss, "zway_uptime_seconds", "gauge", "Seconds since the server started.");
+
+    MetricsExporter::writeValue(ss, "zway_uptime_seconds", "", (boost::posix_time::second_clock::local_time() - m_startTime).total_seconds());
+
+    MetricsExporter::writeHeader(ss, "zway_sessions_accepted_total", "counter", "Connections accepted.");
+
+    MetricsExporter::writeValue(ss, "zway_sessions_accepted_total", "", m_numSessions.load());
+
+    MetricsExporter::writeHeader(ss, "zway_sessions_open", "gauge", "Connections currently open.");
+
+    MetricsExporter::writeValue(ss, "zway_sessions_open", "", numOpen);
+
+    MetricsExporter::writeHeader(ss, "zway_accounts_online", "gauge", "Accounts with at least one logged in session.");
+
+    MetricsExporter::writeValue(ss, "zway_accounts_online", "", accountsOnline.size());
+
+    MetricsExporter::writeHeader(ss, "zway_send_queue_bytes", "gauge", "Bytes queued for sending across all sessions.");
+
+    MetricsExporter::writeValue(ss, "zway_send_queue_bytes", "", queuedBytes);
+
+    // traffic
+
+    MetricsExporter::writeHeader(ss, "zway_received_bytes_total", "counter", "Bytes read from client sockets.");
+
+    MetricsExporter::writeValue(ss, "zway_received_bytes_total", "", Metrics::counter(Metrics::BytesIn));
+
+    MetricsExporter::writeHeader(ss, "zway_sent_bytes_total", "counter", "Bytes written to client sockets.");
+
+    MetricsExporter::writeValue(ss, "zway_sent_bytes_total", "", Metrics::counter(Metrics::BytesOut));
+
+    MetricsExporter::writeHeader(ss, "zway_received_packets_total", "counter", "Packets received from clients.");
+
+    MetricsExporter::writeValue(ss, "zway_received_packets_total", "", Metrics::counter(Metrics::PacketsIn));
+
+    MetricsExporter::writeHeader(ss, "zway_sent_packets_total", "counter", "Packets sent to clients.");
+
+    MetricsExporter::writeValue(ss, "zway_sent_packets_total", "", Metrics::counter(Metrics::PacketsOut));
+
+    MetricsExporter::writeHeader(ss, "zway_socket_writes_total", "counter", "Socket writes, each carrying a batch of packets.");
+
+    MetricsExporter::writeValue(ss, "zway_socket_writes_total", "", Metrics::counter(Metrics::Writes));
+
+    const char *laneNames[ClientSession::NumLanes] = {"control", "bulk"};
+
+    MetricsExporter::writeHeader(ss, "zway_send_queue_delay_seconds", "histogram", "Time outbound packets spent queued, by lane.");
+
+    for (uint32_t i=0; i<ClientSession::NumLanes; ++i) {
+
+        MetricsExporter::writeHistogram(ss, "zway_send_queue_delay_seconds", std::string("lane=\"") + laneNames[i] + "\"", *laneLatency(i));
+    }
+
+    // requests
+
+    std::vector<RequestDispatcher::Stats> requestStats = RequestDispatcher::stats();
+
+    MetricsExporter::writeHeader(ss, "zway_requests_total", "counter", "Requests handled, by type and result.");
+
+    for (RequestDispatcher::Stats &stats : requestStats) {
+
+        std::string type = "type=\"" + stats.name + "\"";
 
-            sessionList += ss.str();
+        MetricsExporter::writeValue(ss, "zway_requests_total", type + ",result=\"success\"", stats.success);
+
+        MetricsExporter::writeValue(ss, "zway_requests_total", type + ",result=\"failure\"", stats.failure);
+    }
+
+    MetricsExporter::writeHeader(ss, "zway_request_duration_seconds", "histogram", "Time from request arrival to response, by type.");
+
+    for (RequestDispatcher::Stats &stats : requestStats) {
+
+        MetricsExporter::writeHistogram(ss, "zway_request_duration_seconds", "type=\"" + stats.name + "\"", *stats.latency);
+    }
+
+    // database
+
+    MetricsExporter::writeHeader(ss, "zway_db_queries_total", "counter", "Database connections acquired.");
+
+    MetricsExporter::writeValue(ss, "zway_db_queries_total", "", Metrics::counter(Metrics::DbQueries));
+
+    MetricsExporter::writeHeader(ss, "zway_db_pool_wait_seconds", "histogram", "Time spent waiting for a pooled database connection.");
+
+    MetricsExporter::writeHistogram(ss, "zway_db_pool_wait_seconds", "", *Metrics::timer(Metrics::DbWait));
+
+    MetricsExporter::writeHeader(ss, "zway_db_queue_depth", "gauge", "Database jobs waiting for the executor.");
+
+    MetricsExporter::writeValue(ss, "zway_db_queue_depth", "", DB::numQueuedJobs());
+
+    MetricsExporter::writeHeader(ss, "zway_db_connections", "gauge", "Pooled database connections, by state.");
+
+    MetricsExporter::writeValue(ss, "zway_db_connections", "state=\"idle\"", DB::numIdleConnections());
+
+    MetricsExporter::writeValue(ss, "zway_db_connections", "state=\"busy\"", DB::numBusyConnections());
+
+    MetricsExporter::writeValue(ss, "zway_db_connections", "state=\"open\"", DB::numConnections());
+
+    MetricsExporter::writeHeader(ss, "zway_db_pool_waiters", "gauge", "Queries waiting for a pooled database connection.");
+
+    MetricsExporter::writeValue(ss, "zway_db_pool_waiters", "", DB::numWaiters());
+
+    MetricsExporter::writeHeader(ss, "zway_db_pool_timeouts_total", "counter", "Queries that gave up waiting for a connection.");
+
+    MetricsExporter::writeValue(ss, "zway_db_pool_timeouts_total", "", Metrics::counter(Metrics::DbTimeouts));
+
+    MetricsExporter::writeHeader(ss, "zway_db_connections_opened_total", "counter", "Database connections opened.");
+
+    MetricsExporter::writeValue(ss, "zway_db_connections_opened_total", "", Metrics::counter(Metrics::DbOpened));
+
+    MetricsExporter::writeHeader(ss, "zway_db_connections_closed_total", "counter", "Database connections closed as idle or broken.");
+
+    MetricsExporter::writeValue(ss, "zway_db_connections_closed_total", "", Metrics::counter(Metrics::DbClosed));
+
+    MetricsExporter::writeHeader(ss, "zway_account_cache_lookups_total", "counter", "Account cache lookups by id, by result.");
+
+    MetricsExporter::writeValue(ss, "zway_account_cache_lookups_total", "result=\"hit\"", Metrics::counter(Metrics::AccountCacheHits));
+
+    MetricsExporter::writeValue(ss, "zway_account_cache_lookups_total", "result=\"miss\"", Metrics::counter(Metrics::AccountCacheMisses));
+
+    MetricsExporter::writeHeader(ss, "zway_account_cache_entries", "gauge", "Accounts held by the account cache.");
+
+    MetricsExporter::writeValue(ss, "zway_account_cache_entries", "", AccountCache::size());
+
+    // stream buffers
+
+    uint64_t bufferCount = 0;
+
+    uint64_t bufferBytes = 0;
+
+    {
+        ThreadSafeMutex::scoped_lock lock(m_buffers);
+
+        for (auto &it : *m_buffers) {
+
+            bufferBytes += it.second->bytesReadable();
         }
+
+        bufferCount = m_buffers->size();
     }
 
-    LOG_INFO <<
-                "Status info:\n" <<
-                "Duration: " << uptimeStr() << "\n" <<
-                "Stream buffers: " << numStreamBuffers() << "\n" <<
-                "Sessions: " << m_sessions->size() << "\n" <<
-                sessionList;
+    MetricsExporter::writeHeader(ss, "zway_stream_buffers", "gauge", "Stream buffers held by the server.");
+
+    MetricsExporter::writeValue(ss, "zway_stream_buffers", "", bufferCount);
+
+    MetricsExporter::writeHeader(ss, "zway_stream_buffer_bytes", "gauge", "Bytes buffered and not yet read.");
+
+    MetricsExporter::writeValue(ss, "zway_stream_buffer_bytes", "", bufferBytes);
+
+    // push notifications
+
+    MetricsExporter::writeHeader(ss, "zway_fcm_messages_total", "counter", "FCM messages sent, by result.");
+
+    MetricsExporter::writeValue(ss, "zway_fcm_messages_total", "result=\"success\"", Metrics::counter(Metrics::FcmSent));
+
+    MetricsExporter::writeValue(ss, "zway_fcm_messages_total", "result=\"failure\"", Metrics::counter(Metrics::FcmFailed));
+
+    MetricsExporter::writeValue(ss, "zway_fcm_messages_total", "result=\"dropped\"", Metrics::counter(Metrics::FcmDropped));
+
+    MetricsExporter::writeHeader(ss, "zway_fcm_send_seconds", "histogram", "FCM message delivery latency.");
+
+    MetricsExporter::writeHistogram(ss, "zway_fcm_send_seconds", "", *Metrics::timer(Metrics::FcmSend));
+
+    MetricsExporter::writeHeader(ss, "zway_fcm_inflight", "gauge", "FCM messages currently being delivered.");
+
+    MetricsExporter::writeValue(ss, "zway_fcm_inflight", "", FcmSender::numInflight());
+
+    MetricsExporter::writeHeader(ss, "zway_fcm_queue_depth", "gauge", "FCM messages waiting for a sender thread.");
+
+    MetricsExporter::writeValue(ss, "zway_fcm_queue_depth", "", FcmSender::numQueued());
+
+    // tls
+
+    MetricsExporter::writeHeader(ss, "zway_tls_handshakes_total", "counter", "TLS handshakes, by session resumption.");
+
+    MetricsExporter::writeValue(ss, "zway_tls_handshakes_total", "mode=\"resumed\"", TlsSessionCache::numResumedHandshakes());
+
+    MetricsExporter::writeValue(ss, "zway_tls_handshakes_total", "mode=\"full\"", TlsSessionCache::numFullHandshakes());
+
+#ifdef ZWAY_LOCK_PROFILING
+    // locks
+
+    std::vector<LockProfiler::Stats> lockStats = LockProfiler::stats();
+
+    MetricsExporter::writeHeader(ss, "zway_lock_acquisitions_total", "counter", "ThreadSafe lock acquisitions, by lock.");
+
+    for (LockProfiler::Stats &stats : lockStats) {
+
+        MetricsExporter::writeValue(ss, "zway_lock_acquisitions_total", "lock=\"" + stats.name + "\"", stats.acquisitions);
+    }
+
+    MetricsExporter::writeHeader(ss, "zway_lock_contended_total", "counter", "ThreadSafe lock acquisitions that had to wait, by lock.");
+
+    for (LockProfiler::Stats &stats : lockStats) {
+
+        MetricsExporter::writeValue(ss, "zway_lock_contended_total", "lock=\"" + stats.name + "\"", stats.contended);
+    }
+
+    MetricsExporter::writeHeader(ss, "zway_lock_wait_seconds_total", "counter", "Time spent waiting for ThreadSafe locks, by lock.");
+
+    for (LockProfiler::Stats &stats : lockStats) {
+
+        MetricsExporter::writeValue(ss, "zway_lock_wait_seconds_total", "lock=\"" + stats.name + "\"", stats.waitTime / 1e9);
+    }
+
+    MetricsExporter::writeHeader(ss, "zway_lock_hold_seconds_total", "counter", "Time ThreadSafe locks were held, by lock.");
+
+    for (LockProfiler::Stats &stats : lockStats) {
+
+        MetricsExporter::writeValue(ss, "zway_lock_hold_seconds_total", "lock=\"" + stats.name + "\"", stats.holdTime / 1e9);
+    }
+#endif
+
+    return ss.str();
 }
 
 // ============================================================ //
@@ -455,41 +977,45 @@ boost::shared_ptr<boost::asio::io_service> Server::io_service()
 
 // ============================================================ //
 
-void Server::onTimer(const boost::system::error_code &error)
+IO_SERVICE_POOL Server::ioServicePool()
 {
-    if (!error) {
+    return m_ioPool;
+}
 
-        {
-            boost::mutex::scoped_lock locker(m_senders);
+// ============================================================ //
 
-            std::list<STREAM_BUFFER_SENDER> remove;
+HISTOGRAM Server::laneLatency(uint32_t lane)
+{
+    return Metrics::timer(lane == ClientSession::ControlLane ? Metrics::ControlLaneDelay : Metrics::BulkLaneDelay);
+}
 
-            for (STREAM_BUFFER_SENDER &sender : *m_senders) {
+// ============================================================ //
 
-                if (sender->status() == StreamBufferSender::Completed) {
+TIMER_WHEEL Server::timerWheel(uint32_t shard)
+{
+    return m_timerWheels[shard % m_timerWheels.size()];
+}
 
-                    remove.push_back(sender);
-                }
-                else {
+// ============================================================ //
 
-                    sender->session()->sendPacket();
-                }
-            }
+const Server::Options &Server::options() const
+{
+    return m_options;
+}
 
-            for (STREAM_BUFFER_SENDER &sender : remove) {
+// ============================================================ //
 
-                m_senders->remove(sender);
-            }
-        }
+void Server::onTimer(const boost::system::error_code &error)
+{
+    if (!error) {
 
+        std::list<STREAM_BUFFER> remove;
 
         {
-            boost::mutex::scoped_lock locker(m_buffers);
+            ThreadSafeMutex::scoped_lock locker(m_buffers);
 
             uint64_t t = time(nullptr);
 
-            std::list<STREAM_BUFFER> remove;
-
             for (auto &it : *m_buffers) {
 
                 STREAM_BUFFER &buffer = it.second;
@@ -506,6 +1032,26 @@ void Server::onTimer(const boost::system::error_code &error)
             }
         }
 
+        // senders of an expired buffer get no more chunks,
+        // nothing else would remove them
+
+        for (STREAM_BUFFER &buffer : remove) {
+
+            removeStreamBufferSenders(buffer->streamId());
+        }
+
+        DB::maintain();
+
+#ifdef ZWAY_LOCK_PROFILING
+        boost::posix_time::ptime now = boost::posix_time::second_clock::local_time();
+
+        if ((now - m_lockReportTime).total_seconds() >= LOCK_PROFILE_INTERVAL) {
+
+            m_lockReportTime = now;
+
+            LOG_INFO << LockProfiler::report();
+        }
+#endif
 
         m_timer.expires_from_now(boost::posix_time::milliseconds(2000));
 
@@ -538,44 +1084,146 @@ std::string Server::uptimeStr()
 
 // ============================================================ //
 
-void Server::accept()
+bool Server::listen()
 {
+    using namespace boost::asio::ip;
+
+    // with more than one acceptor every acceptor binds the same
+    // endpoint with SO_REUSEPORT and the kernel balances incoming
+    // connections across them
+
+    try {
+
+        for (uint32_t i=0; i<m_options.numAcceptors; ++i) {
+
+            ACCEPTOR acceptor = boost::make_shared<tcp::acceptor>(m_ioPool->shard(i)->io_service());
+
+            acceptor->open(tcp::v4());
+
+            acceptor->set_option(tcp::acceptor::reuse_address(true));
+
+            if (m_options.numAcceptors > 1) {
+
+                acceptor->set_option(reuse_port(true));
+            }
+
+            acceptor->bind(m_endpoint);
+
+            acceptor->listen();
+
+            m_acceptors.push_back(acceptor);
+        }
+    }
+    catch (std::exception& e) {
+
+        LOG_ERROR << e.what();
+
+        closeAcceptors();
+
+        return false;
+    }
+
+    for (uint32_t i=0; i<m_acceptors.size(); ++i) {
+
+        for (uint32_t j=0; j<m_options.pendingAccepts; ++j) {
+
+            accept(m_acceptors[i], m_ioPool->shard(i));
+        }
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+void Server::closeAcceptors()
+{
+    // pending accepts complete with operation_aborted,
+    // their handlers keep the acceptor alive until then
+
+    for (ACCEPTOR &acceptor : m_acceptors) {
+
+        boost::system::error_code ec;
+
+        acceptor->close(ec);
+    }
+
+    m_acceptors.clear();
+}
+
+// ============================================================ //
+
+void Server::accept(ACCEPTOR acceptor, IO_SERVICE_SHARD shard)
+{
+    // the session is bound to its shard for its whole
+    // lifetime, the acceptor only hands it over
+
     CLIENT_SESSION session =
             ClientSession::create(
                     this,
-                    m_acceptor.get_io_service(),
+                    m_ioPool->select(),
                     m_context);
 
-    m_acceptor.async_accept(
+    acceptor->async_accept(
             session->socket(),
             boost::bind(&Server::handleSession,
                     this,
                     boost::asio::placeholders::error,
+                    acceptor,
+                    shard,
                     session));
 }
 
 // ============================================================ //
 
+void Server::retryAccept(ACCEPTOR acceptor, IO_SERVICE_SHARD shard)
+{
+    // the timer runs on the shard of the acceptor, so the
+    // acceptor is still only used from its own thread
+
+    boost::shared_ptr<boost::asio::deadline_timer> timer =
+            boost::make_shared<boost::asio::deadline_timer>(
+                    shard->io_service(),
+                    boost::posix_time::milliseconds(ACCEPT_RETRY_DELAY));
+
+    timer->async_wait([this, timer, acceptor, shard] (const boost::system::error_code &error) {
+
+        if (!error && acceptor->is_open()) {
+
+            accept(acceptor, shard);
+        }
+    });
+}
+
+// ============================================================ //
+
 void Server::handleSession(
         const boost::system::error_code& error,
+        ACCEPTOR acceptor,
+        IO_SERVICE_SHARD shard,
         CLIENT_SESSION session)
 {
     if (!error) {
 
-        session->start();
+        session->execute(boost::bind(&ClientSession::start, session));
 
         m_numSessions++;
 
-        accept();
+        accept(acceptor, shard);
     }
     else {
 
-        if (error == boost::asio::error::operation_aborted) {
+        if (error == boost::asio::error::operation_aborted || !acceptor->is_open()) {
 
             return;
         }
 
         LOG_ERROR << "handleSession: " << error.message();
+
+        // errors like EMFILE or ENFILE are transient, re-arm
+        // the accept after a short delay instead of losing it
+
+        retryAccept(acceptor, shard);
     }
 }
 
@@ -29,18 +29,24 @@
 
 #include "logger.h"
 #include "server.h"
+#include "metrics.h"
 #include "session.h"
+#include "packetpool.h"
+#include "tlssessioncache.h"
 #include "streambuffersender.h"
 #include "request/addcontact.h"
 #include "request/rejectcontact.h"
 #include "request/acceptcontact.h"
 #include "request/pushrequest.h"
 #include "request/dispatch.h"
+#include "task.h"
+#include "requestdispatcher.h"
 
 #include "Zway/core/ubjreceiver.h"
 
 #include <sstream>
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/algorithm/hex.hpp>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -48,40 +54,75 @@
 
 #include <openssl/rand.h>
 
+#include <chrono>
+
 using namespace mongo;
 
+// ============================================================ //
+
+static uint64_t nowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 // ============================================================ //
 // ClientSession
 // ============================================================ //
 
-CLIENT_SESSION ClientSession::create(Server *server, boost::asio::io_service &io_service, boost::asio::ssl::context &context)
+CLIENT_SESSION ClientSession::create(Server *server, IO_SERVICE_SHARD shard, boost::asio::ssl::context &context)
 {
-    return CLIENT_SESSION(new ClientSession(server, io_service, context));
+    return CLIENT_SESSION(new ClientSession(server, shard, context));
 }
 
 // ============================================================ //
 
-ClientSession::ClientSession(Server *server, boost::asio::io_service &io_service, boost::asio::ssl::context &context)
+ClientSession::ClientSession(Server *server, IO_SERVICE_SHARD shard, boost::asio::ssl::context &context)
     : Zway::Engine(),
       m_server(server),
-      m_socket(io_service, context),
-      m_timer(io_service),
+      m_shard(shard),
+      m_started(false),
+      m_socket(shard->io_service(), context),
+      m_strand(shard->io_service()),
+      m_timerWheel(server->timerWheel(shard->index())),
       m_status(0),
+      m_remoteHost(LockName("ClientSession::m_remoteHost")),
       m_accountId(0),
+      m_accountName(LockName("ClientSession::m_accountName")),
       m_numPacketsSent(0),
+      m_numWritesSent(0),
       m_numPacketsRecv(0),
-      m_sending(false)
+      m_sending(false),
+      m_recvBuffer(RECV_BUFFER_SIZE),
+      m_recvBegin(0),
+      m_recvEnd(0),
+      m_laneBytes(),
+      m_queuedPackets(0),
+      m_queuedBytes(0),
+      m_sendersPaused(false),
+      m_overLimitSince(0),
+      m_contacts(LockName("ClientSession::m_contacts")),
+      m_presenceAttached(false),
+      m_presenceVisible(false)
 {
 
 }
 
 // ============================================================ //
 
-void ClientSession::setStatus(uint32_t status)
+ClientSession::~ClientSession()
 {
-    boost::mutex::scoped_lock locker(m_status);
+    if (m_started) {
+
+        m_shard->release();
+    }
+}
+
+// ============================================================ //
 
-    m_status = status;
+void ClientSession::setStatus(uint32_t status)
+{
+    m_status.store(status);
 }
 
 // ============================================================ //
@@ -90,34 +131,75 @@ bool ClientSession::setConfig(const Zway::UBJ::Object &config)
 {
     if (config.hasField("contacts")) {
 
-        boost::mutex::scoped_lock locker(m_contacts);
+        std::set<uint32_t> contacts;
+
+        std::set<uint32_t> audience;
+
+        {
+            ThreadSafeMutex::scoped_lock locker(m_contacts);
 
-        m_contacts->clear();
+            m_contacts->clear();
 
-        for (auto &it : config["contacts"].toArray()) {
+            for (auto &it : config["contacts"].toArray()) {
 
-            (*m_contacts)[it["contactId"].toInt()] = it;
+                uint32_t contactId = it["contactId"].toInt();
+
+                (*m_contacts)[contactId] = it;
+
+                contacts.insert(contactId);
+
+                if (it["notifyStatus"].toBool()) {
+
+                    audience.insert(contactId);
+                }
+            }
         }
-    }
 
+        if (m_presenceAttached) {
+
+            Presence &presence = m_server->presence();
 
-    bool newStatus = config["notifyStatus"].toBool();
+            presence.setAudience(accountId(), audience);
 
-    bool curStatus = m_config["notifyStatus"].toBool();
+            presence.unsubscribe(shared_from_this(), m_watching);
+
+            presence.subscribe(shared_from_this(), contacts);
+
+            m_watching = contacts;
+        }
+    }
+
+
+    bool notifyStatus = config["notifyStatus"].toBool();
 
 
     if (config.hasField("fcmToken")) {
 
-        DB::setFcmToken(accountId(), config["fcmToken"].toStr());
+        uint32_t accountId = this->accountId();
+
+        std::string token = config["fcmToken"].toStr();
+
+        DB::post([accountId, token] () {
+
+            DB::setFcmToken(accountId, token);
+        });
     }
 
 
     m_config = config;
 
 
-    if(newStatus != curStatus) {
+    // broadcast only if the status of the account changes,
+    // other sessions of the account may still be visible
+
+    if (m_presenceAttached && notifyStatus != m_presenceVisible) {
+
+        m_presenceVisible = notifyStatus;
+
+        if (m_server->presence().setVisible(accountId(), notifyStatus)) {
 
-        broadcastStatus(newStatus ? 1 : 0, false);
+            broadcastStatus(notifyStatus ? 1 : 0);
+        }
     }
 
 
@@ -128,21 +210,35 @@ bool ClientSession::setConfig(const Zway::UBJ::Object &config)
 
 void ClientSession::start()
 {
+    m_started = true;
+
+    m_shard->acquire();
+
 	// create temporary id for this session,
     // until it's authenticated
 
-    RAND_pseudo_bytes((uint8_t*)&m_accountId, sizeof(m_accountId));
+    uint32_t tempId = 0;
+
+    RAND_pseudo_bytes((uint8_t*)&tempId, sizeof(tempId));
+
+    m_accountId = tempId;
 
 	m_server->appendSession(shared_from_this());
 
+    // start heartbeat timeout, a handshake
+    // that never completes expires as well
+
+    m_timerWheel->add(shared_from_this());
+
     // start handshake
 
     m_socket.async_handshake(
             boost::asio::ssl::stream_base::server,
-            boost::bind(
+            m_strand.wrap(
+                boost::bind(
                     &ClientSession::handleHandshake,
                     shared_from_this(),
-                    boost::asio::placeholders::error));
+                    boost::asio::placeholders::error)));
 }
 
 // ============================================================ //
@@ -153,7 +249,7 @@ void ClientSession::close(bool shutdown, bool remove)
 
     boost::system::error_code ec;
 
-    m_timer.cancel(ec);
+    cancel();
 
     // cancel pending socket requests
 
@@ -189,6 +285,10 @@ void ClientSession::close(bool shutdown, bool remove)
 
     setStatus(STATUS_DISCONNECTED);
 
+    leavePresence();
+
+    m_server->removeStreamBufferSenders(this);
+
     // remove session
 
     if (remove) {
@@ -201,36 +301,42 @@ void ClientSession::close(bool shutdown, bool remove)
 
 // ============================================================ //
 
-void ClientSession::onTimer(const boost::system::error_code &error)
+void ClientSession::onTimeout()
 {
-    if (!error) {
+    // called by the timer wheel on its own thread
 
-        //LOG_ERROR << remoteHost() << " > no heartbeat in " << HEARTBEAT_TIMEOUT << " ms";
+    execute(boost::bind(&ClientSession::onHeartbeatTimeout, shared_from_this()));
+}
 
-        //close(false, false);
-    }
+// ============================================================ //
+
+void ClientSession::onDeadline()
+{
+    // called by the timer wheel once the queue stayed above
+    // the hard limit for SLOW_CONSUMER_TIMEOUT
+
+    execute(boost::bind(&ClientSession::onSlowConsumer, shared_from_this()));
 }
 
 // ============================================================ //
 
-void ClientSession::resetTimer()
+void ClientSession::onHeartbeatTimeout()
 {
-    // reset timer
+    if (cancelled()) {
 
-    m_timer.expires_from_now(boost::posix_time::milliseconds(HEARTBEAT_TIMEOUT));
+        return;
+    }
 
-    m_timer.async_wait(
-                boost::bind(
-                    &ClientSession::onTimer,
-                    shared_from_this(),
-                    boost::asio::placeholders::error));
+    LOG_ERROR << remoteHost() << " > no heartbeat in " << HEARTBEAT_TIMEOUT << " ms";
+
+    close(false, true);
 }
 
 // ============================================================ //
 
-void ClientSession::pauseTimer()
+void ClientSession::touch()
 {
-    m_timer.cancel();
+    m_timerWheel->touch(*this);
 }
 
 // ============================================================ //
@@ -239,6 +345,8 @@ void ClientSession::handleHandshake(const boost::system::error_code &error)
 {
     if (!error) {
 
+        TlsSessionCache::handshakeCompleted(m_socket.native_handle());
+
         // set status
 
         setStatus(STATUS_CONNECTED);
@@ -249,11 +357,11 @@ void ClientSession::handleHandshake(const boost::system::error_code &error)
         s << socket().remote_endpoint().address().to_string() << ":"
           << socket().remote_endpoint().port();
 
-        m_remoteHost = s.str();
-
-        // start heartbeat timer
+        {
+            ThreadSafeMutex::scoped_lock lock(m_remoteHost);
 
-        resetTimer();
+            m_remoteHost = s.str();
+        }
 
         LOG_INFO << remoteHost() << " > session started";
 
@@ -274,14 +382,22 @@ void ClientSession::handleHandshake(const boost::system::error_code &error)
 
 void ClientSession::onPacketSent(
         const boost::system::error_code &error,
-        size_t,
-        Zway::PACKET)
+        size_t bytes_transferred,
+        uint32_t numPackets)
 {
     if (!error) {
 
-        resetTimer();
+        touch();
+
+        m_numPacketsSent += numPackets;
 
-        m_numPacketsSent++;
+        m_numWritesSent++;
+
+        Metrics::add(Metrics::BytesOut, bytes_transferred);
+
+        Metrics::add(Metrics::PacketsOut, numPackets);
+
+        Metrics::add(Metrics::Writes);
     }
     else {
 
@@ -290,11 +406,7 @@ void ClientSession::onPacketSent(
         // ...
     }
 
-    {
-        boost::mutex::scoped_lock locker(m_sending);
-
-        m_sending = false;
-    }
+    m_sending = false;
 
     sendPacket();
 }
@@ -305,10 +417,12 @@ void ClientSession::onPacketRecv(Zway::PACKET pkt)
 {
     m_numPacketsRecv++;
 
+    Metrics::add(Metrics::PacketsIn);
+
     /*
     if (pkt->id() == Zway::Packet::HeartbeatId) {
 
-        resetTimer();
+        touch();
 
         postPacket(Zway::Packet::create(Zway::Packet::HeartbeatId));
     }
@@ -331,29 +445,110 @@ void ClientSession::onPacketRecv(Zway::PACKET pkt)
 
         // ...
     }
-
-    recvPacket();
 }
 
 // ============================================================ //
 
 void ClientSession::onPacketHeadRecv(
         const boost::system::error_code &error,
-        size_t bytes_transferred,
-        Zway::PACKET pkt)
+        size_t bytes_transferred)
 {
-    if (!error && bytes_transferred == sizeof(Zway::Packet::Head)) {
+    if (!error && bytes_transferred > 0) {
 
-        resetTimer();
+        touch();
 
-        if (pkt->bodySize() > 0) {
+        Metrics::add(Metrics::BytesIn, bytes_transferred);
 
-            recvPacketBody(pkt);
-        }
-        else {
+        m_recvEnd += bytes_transferred;
+
+        // parse as many packets as the buffer holds
+
+        while (m_recvEnd - m_recvBegin >= sizeof(Zway::Packet::Head)) {
+
+            Zway::PACKET pkt = PacketPool::createPacket();
+
+            if (!pkt) {
+
+                close(false, true);
+
+                return;
+            }
+
+            memcpy(&pkt->head(), &m_recvBuffer[m_recvBegin], sizeof(Zway::Packet::Head));
+
+            size_t bodySize = pkt->bodySize();
+
+            if (bodySize > Zway::MAX_PACKET_BODY) {
+
+                LOG_ERROR << remoteHost() << " > invalid packet size: " << bodySize;
+
+                close(false, true);
+
+                return;
+            }
+
+            size_t bodyOffset = m_recvBegin + sizeof(Zway::Packet::Head);
+
+            size_t bodyAvailable = m_recvEnd - bodyOffset;
+
+            if (bodyAvailable < bodySize) {
+
+                // wait for the rest of the packet if it fits
+                // into the buffer, otherwise read the remaining
+                // body directly into its own buffer
+
+                if (sizeof(Zway::Packet::Head) + bodySize <= m_recvBuffer.size()) {
+
+                    break;
+                }
+
+                Zway::BUFFER body = PacketPool::createBuffer(bodySize);
+
+                if (!body) {
+
+                    close(false, true);
+
+                    return;
+                }
+
+                memcpy(body->data(), &m_recvBuffer[bodyOffset], bodyAvailable);
+
+                pkt->setBody(body);
+
+                m_recvBegin = m_recvEnd = 0;
+
+                recvPacketBody(pkt, bodyAvailable);
+
+                return;
+            }
+
+            if (bodySize > 0) {
+
+                Zway::BUFFER body = PacketPool::createBuffer(bodySize);
+
+                if (!body) {
+
+                    close(false, true);
+
+                    return;
+                }
+
+                memcpy(body->data(), &m_recvBuffer[bodyOffset], bodySize);
+
+                pkt->setBody(body);
+            }
+
+            m_recvBegin = bodyOffset + bodySize;
 
             onPacketRecv(pkt);
+
+            if (status() == STATUS_DISCONNECTED) {
+
+                return;
+            }
         }
+
+        recvPacket();
     }
     else {
 
@@ -393,179 +588,842 @@ void ClientSession::onPacketBodyRecv(
         size_t offset,
         Zway::PACKET pkt)
 {
+    if (!error) {
+
+        Metrics::add(Metrics::BytesIn, bytes_transferred);
+    }
+
     if (!error && offset + bytes_transferred < pkt->bodySize()) {
 
         uint32_t packetOffset = offset + bytes_transferred;
 
-        m_socket.async_read_some(
-                boost::asio::buffer(pkt->body()->data() + packetOffset, pkt->bodySize() - packetOffset),
+        m_socket.async_read_some(
+                boost::asio::buffer(pkt->body()->data() + packetOffset, pkt->bodySize() - packetOffset),
+                m_strand.wrap(
+                    boost::bind(
+                        &ClientSession::onPacketBodyRecv,
+                        shared_from_this(),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred,
+                        packetOffset,
+                        pkt)));
+    }
+    else
+    if (!error && offset + bytes_transferred == pkt->bodySize()) {
+
+        touch();
+
+        onPacketRecv(pkt);
+
+        if (status() != STATUS_DISCONNECTED) {
+
+            recvPacket();
+        }
+    }
+    else {
+
+        if (error == boost::asio::error::connection_aborted ||
+            error == boost::asio::error::connection_reset ||
+            error == boost::asio::error::eof ||
+            error.value() == 0x140000DB) {
+
+            close(false, true);
+
+            return;
+        }
+        else
+        if (error == boost::asio::error::operation_aborted) {
+
+            return;
+        }
+
+        // ...
+    }
+}
+
+// ============================================================ //
+
+bool ClientSession::sendPacket()
+{
+    if (m_sending) {
+
+        return false;
+    }
+
+    // drain packets from the lanes until the batch budget is used up,
+    // refilling the lanes from the stream senders when they run dry.
+    // the batch is copied into one contiguous buffer, since the ssl
+    // stream encrypts only one buffer of a sequence per SSL_write
+
+    const Server::Options &options = m_server->options();
+
+    uint32_t numPackets = 0;
+
+    size_t bulkBytes = 0;
+
+    // a batch stops after the packet crossing sendBatchBytes, so
+    // reserving one more packet keeps the buffer from growing
+
+    size_t reserve = options.sendBatchBytes + sizeof(Zway::Packet::Head) + Zway::MAX_PACKET_BODY;
+
+    m_sendBuffer.clear();
+
+    if (m_sendBuffer.capacity() < reserve) {
+
+        m_sendBuffer.reserve(reserve);
+    }
+
+    while (numPackets < options.sendBatchPackets && m_sendBuffer.size() < options.sendBatchBytes) {
+
+        if (m_lanes[ControlLane].empty() && m_lanes[BulkLane].empty()) {
+
+            pollStreamSenders();
+
+            if (m_lanes[ControlLane].empty() && m_lanes[BulkLane].empty()) {
+
+                break;
+            }
+        }
+
+        // control packets go first, but the bulk lane
+        // gets at least its share of the batch bytes
+
+        Lane lane = ControlLane;
+
+        if (m_lanes[ControlLane].empty() ||
+                (!m_lanes[BulkLane].empty() && bulkBytes * 100 < m_sendBuffer.size() * options.bulkShare)) {
+
+            lane = BulkLane;
+        }
+
+        Zway::PACKET pkt = dequeuePacket(lane);
+
+        if (!pkt) {
+
+            continue;
+        }
+
+        // add packet head
+
+        const uint8_t *head = (const uint8_t*)&pkt->head();
+
+        m_sendBuffer.insert(m_sendBuffer.end(), head, head + sizeof(Zway::Packet::Head));
+
+        // add packet body
+
+        if (pkt->bodySize() > 0) {
+
+            const uint8_t *body = (const uint8_t*)pkt->bodyData();
+
+            m_sendBuffer.insert(m_sendBuffer.end(), body, body + pkt->bodySize());
+        }
+
+        if (lane == BulkLane) {
+
+            bulkBytes += sizeof(Zway::Packet::Head) + pkt->bodySize();
+        }
+
+        numPackets++;
+    }
+
+    if (!numPackets)  {
+
+        // the queues are drained, give back what an
+        // oversized packet added beyond the reserve
+
+        if (m_sendBuffer.capacity() > reserve) {
+
+            std::vector<uint8_t> buffer;
+
+            buffer.reserve(reserve);
+
+            m_sendBuffer.swap(buffer);
+        }
+
+        return false;
+    }
+
+    // send packets
+
+    m_sending = true;
+
+    boost::asio::async_write(
+            m_socket,
+            boost::asio::buffer(m_sendBuffer),
+            m_strand.wrap(
+                boost::bind(
+                    &ClientSession::onPacketSent,
+                    shared_from_this(),
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred,
+                    numPackets)));
+
+    return true;
+}
+
+// ============================================================ //
+
+void ClientSession::pollStreamSenders()
+{
+    // called when the lanes ran dry, pull about one batch from the
+    // stream senders. the high watermark only caps the queue, since
+    // enqueuePacket pauses the senders when it is reached
+
+    const Server::Options &options = m_server->options();
+
+    while (!m_sendersPaused && m_queuedBytes < options.sendBatchBytes) {
+
+        uint32_t numPackets = m_queuedPackets;
+
+        Zway::Engine::processStreamSenders(true, [this] (Zway::PACKET pkt) -> bool {
+
+            enqueuePacket(pkt);
+
+            return true;
+        });
+
+        if (m_queuedPackets == numPackets) {
+
+            break;
+        }
+    }
+}
+
+// ============================================================ //
+
+void ClientSession::enqueuePacket(Zway::PACKET pkt)
+{
+    const Server::Options &options = m_server->options();
+
+    Lane lane = pkt->streamType() == Zway::Packet::Resource ? BulkLane : ControlLane;
+
+    uint64_t size = sizeof(Zway::Packet::Head) + pkt->bodySize();
+
+    m_lanes[lane].push({pkt, nowMicros()});
+
+    m_laneBytes[lane] += size;
+
+    m_queuedPackets++;
+
+    uint64_t queuedBytes = m_queuedBytes += size;
+
+    if (queuedBytes >= options.sendQueueHighWatermark) {
+
+        m_sendersPaused = true;
+    }
+
+    // a client that stays above the hard limit for too long is
+    // considered a slow consumer, the timer wheel checks the deadline
+
+    if (queuedBytes > options.sendQueueHardLimit && !m_overLimitSince) {
+
+        m_overLimitSince = m_timerWheel->now();
+
+        m_timerWheel->setDeadline(shared_from_this(), m_overLimitSince + SLOW_CONSUMER_TIMEOUT);
+    }
+}
+
+// ============================================================ //
+
+Zway::PACKET ClientSession::dequeuePacket(Lane lane)
+{
+    const Server::Options &options = m_server->options();
+
+    QueuedPacket &entry = m_lanes[lane].front();
+
+    Zway::PACKET pkt = entry.pkt;
+
+    Metrics::observe(lane == ControlLane ? Metrics::ControlLaneDelay : Metrics::BulkLaneDelay, nowMicros() - entry.time);
+
+    m_lanes[lane].pop();
+
+    uint64_t size = sizeof(Zway::Packet::Head) + (pkt ? pkt->bodySize() : 0);
+
+    m_laneBytes[lane] -= size;
+
+    m_queuedPackets--;
+
+    uint64_t queuedBytes = m_queuedBytes -= size;
+
+    if (queuedBytes <= options.sendQueueLowWatermark) {
+
+        m_sendersPaused = false;
+    }
+
+    if (queuedBytes <= options.sendQueueHardLimit && m_overLimitSince) {
+
+        m_overLimitSince = 0;
+
+        m_timerWheel->clearDeadline(*this);
+    }
+
+    return pkt;
+}
+
+// ============================================================ //
+
+void ClientSession::onSlowConsumer()
+{
+    if (cancelled() || !m_overLimitSince) {
+
+        return;
+    }
+
+    LOG_ERROR << remoteHost() << " > slow consumer, " << m_queuedBytes << " bytes queued";
+
+    close(false, true);
+}
+
+// ============================================================ //
+
+bool ClientSession::recvPacket()
+{
+    // move a partially received packet to the front,
+    // so there is room to read the rest of it
+
+    if (m_recvBegin > 0) {
+
+        if (m_recvEnd > m_recvBegin) {
+
+            memmove(&m_recvBuffer[0], &m_recvBuffer[m_recvBegin], m_recvEnd - m_recvBegin);
+        }
+
+        m_recvEnd -= m_recvBegin;
+
+        m_recvBegin = 0;
+    }
+
+    m_socket.async_read_some(
+                boost::asio::buffer(&m_recvBuffer[m_recvEnd], m_recvBuffer.size() - m_recvEnd),
+                m_strand.wrap(
+                    boost::bind(
+                        &ClientSession::onPacketHeadRecv,
+                        shared_from_this(),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred)));
+
+    return true;
+}
+
+// ============================================================ //
+
+void ClientSession::recvPacketBody(Zway::PACKET pkt, size_t offset)
+{
+    Zway::BUFFER body = pkt->body();
+
+    m_socket.async_read_some(
+                boost::asio::buffer(body->data() + offset, pkt->bodySize() - offset),
+                m_strand.wrap(
+                    boost::bind(
+                        &ClientSession::onPacketBodyRecv,
+                        shared_from_this(),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred,
+                        offset,
+                        pkt)));
+}
+
+// ============================================================ //
+
+template <class Result>
+void ClientSession::dbQuery(
+        const boost::function<Result ()> &query,
+        const boost::function<void (const Result&)> &handler)
+{
+    CLIENT_SESSION self = shared_from_this();
+
+    DB::async<Result>(
+                query,
+                [self, handler] (const Result &res) {
+
+                    // the session may have been closed meanwhile
+
+                    if (self->status() != STATUS_DISCONNECTED) {
+
+                        handler(res);
+                    }
+                },
+                [self] (const boost::function<void ()> &completion) {
+
+                    self->execute(completion);
+                });
+}
+
+// ============================================================ //
+// Request tasks
+// ============================================================ //
+
+#include <boost/asio/yield.hpp>
+
+namespace {
+
+struct Document
+{
+    bool found;
+
+    BSONObj obj;
+};
+
+Document getAccount(const BSONObj &query, const BSONObj &fieldsToReturn)
+{
+    Document res;
+
+    res.found = DB::getAccount(query, fieldsToReturn, res.obj);
+
+    return res;
+}
+
+Document getRequest(const BSONObj &query)
+{
+    Document res;
+
+    res.found = DB::getRequest(query, res.obj);
+
+    return res;
+}
+
+}
+
+// ============================================================ //
+
+class ClientSession::LoginTask : public Task<ClientSession::LoginTask>
+{
+public:
+
+    void operator()();
+
+    uint32_t requestId;
+
+    uint32_t accountId;
+
+    Zway::UBJ::Object head;
+
+    Document account;
+
+    Zway::UBJ::Array inbox;
+
+    bool inboxLoaded;
+};
+
+// ============================================================ //
+
+class ClientSession::AddContactTask : public Task<ClientSession::AddContactTask>
+{
+public:
+
+    void operator()();
+
+    uint32_t requestId;
+
+    uint32_t accountId;
+
+    std::string addCode;
+
+    std::string label;
+
+    bool hasPublicKey;
+
+    BSONObj publicKey;
+
+    Document account;
+
+    Document request;
+
+    BSONObj contactQuery;
+
+    Document contact;
+
+    uint32_t contactAccountId;
+
+    bool pending;
+
+    bool added;
+};
+
+// ============================================================ //
+
+class ClientSession::AcceptContactTask : public Task<ClientSession::AcceptContactTask>
+{
+public:
+
+    void operator()();
+
+    uint32_t requestId;
+
+    uint32_t contactRequestId;
+
+    uint32_t accountId;
+
+    bool hasPublicKey;
+
+    BSONObj publicKey;
+
+    Document request;
+
+    Document account;
+
+    uint32_t requestSrc;
+
+    bool added;
+
+    bool deleted;
+};
+
+// ============================================================ //
+
+void ClientSession::LoginTask::operator()()
+{
+    ClientSession *s = m_session.get();
+
+    reenter (this) {
+
+        yield await(boost::bind(getAccount, BSON("id" << accountId), BSON("name" << 1 << "pass" << 1 << "salt" << 1)), account);
+
+        if (!account.found) {
+
+            s->postRequestFailure(requestId, 0, "Invalid account id");
+
+            return;
+        }
+
+        // another login may have completed meanwhile
+
+        if (s->status() >= STATUS_LOGGEDIN) {
+
+            s->postRequestFailure(requestId, 0, "Operation not permitted");
+
+            return;
+        }
+
+        if (!s->verifyPassword(account.obj, head["password"].buffer())) {
+
+            s->postRequestFailure(requestId, 0, "login failed");
+
+            return;
+        }
+
+
+        s->setStatus(STATUS_LOGGEDIN);
+
+        // remove temporary session
+
+        s->leavePresence();
+
+        s->m_server->removeSession(m_session);
+
+        // append authenticated session
+
+        s->m_accountId = accountId;
+
+        {
+            ThreadSafeMutex::scoped_lock lock(s->m_accountName);
+
+            s->m_accountName = account.obj["name"].str();
+        }
+
+        s->m_server->appendSession(m_session);
+
+        s->m_server->presence().attach(accountId);
+
+        s->m_presenceAttached = true;
+
+
+        // set config
+
+        if (head.hasField("config")) {
+
+            if (!s->setConfig(head["config"])) {
+
+            }
+        }
+
+
+        yield await(boost::bind(DB::getInbox, boost::ref(inbox), accountId, 0) , inboxLoaded);
+
+
+        // send response
+
+        s->postRequestSuccess(requestId, UBJ_OBJ("contactStatus" << s->getContactStatus() << "inbox" << inbox));
+
+
+        // process requests
+
+        s->processRequests();
+
+
+        LOG_INFO << s->remoteHost() << " > login > accountId: " << accountId;
+    }
+}
+
+// ============================================================ //
+
+void ClientSession::AddContactTask::operator()()
+{
+    ClientSession *s = m_session.get();
+
+    reenter (this) {
+
+        accountId = s->accountId();
+
+        // get our account data
+
+        yield await(boost::bind(getAccount, BSON("id" << accountId), BSON("name" << 1 << "phone" << 1)), account);
+
+        if (!account.found) {
+
+            s->postRequestFailure(requestId, 0, "Internal server error");
+
+            return;
+        }
+
+        // process add code if supplied
+
+        if (!addCode.empty()) {
+
+            // get request by add code in order to get contact id
+
+            yield await(boost::bind(getRequest, BSON("type" << Zway::Request::AddContact << "addCode" << addCode)), request);
+
+            if (!request.found) {
+
+                s->postRequestFailure(requestId, 0, "invalid add code");
+
+                return;
+            }
+
+            // query contact by account id
+
+            contactQuery = BSON("id" << request.obj["src"]);
+        }
+        else {
+
+            if (label.empty()) {
+
+                s->postRequestFailure(requestId, 0, "no label");
+
+                return;
+            }
+
+            // query contact by label
+
+            contactQuery = BSON("name" << label << "findByName" << true);
+        }
+
+        yield await(boost::bind(getAccount, contactQuery, BSON("id" << 1 << "name" << 1 << "phone" << 1)), contact);
+
+        if (!contact.found) {
+
+            s->postRequestFailure(requestId, 0, "invalid label 1");
+
+            return;
+        }
+
+        contactAccountId = contact.obj["id"].numberInt();
+
+        if (contactAccountId == accountId) {
+
+            s->postRequestFailure(requestId, 0, "invalid label 2");
+
+            return;
+        }
+
+        yield await(
                 boost::bind(
-                    &ClientSession::onPacketBodyRecv,
-                    shared_from_this(),
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred,
-                    packetOffset,
-                    pkt));
-    }
-    else
-    if (!error && offset + bytes_transferred == pkt->bodySize()) {
+                    DB::requestPending,
+                    BSON(
+                        "type" << Zway::Request::AddContact <<
+                        "src"  << accountId <<
+                        "dst"  << contactAccountId)),
+                pending);
 
-        resetTimer();
+        if (pending) {
 
-        onPacketRecv(pkt);
-    }
-    else {
+            s->postRequestFailure(requestId, 0, "invalid data");
 
-        if (error == boost::asio::error::connection_aborted ||
-            error == boost::asio::error::connection_reset ||
-            error == boost::asio::error::eof ||
-            error.value() == 0x140000DB) {
+            return;
+        }
 
-            close(false, true);
+        if (!hasPublicKey) {
+
+            s->postRequestFailure(requestId, 0, "Invalid public key");
 
             return;
         }
-        else
-        if (error == boost::asio::error::operation_aborted) {
+
+        yield await(
+                boost::bind(
+                    DB::addRequest,
+                    BSON(
+                        "id"        << requestId <<
+                        "type"      << Zway::Request::AddContact <<
+                        "time"      << 0 <<
+                        "ttl"       << 0 <<
+                        "src"       << accountId <<
+                        "dst"       << contactAccountId <<
+                        "name"      << account.obj["name"] <<
+                        "phone"     << account.obj["phone"] <<
+                        "publicKey" << publicKey <<
+                        "addCode"   << addCode)),
+                added);
+
+        if (!added) {
+
+            s->postRequestFailure(requestId, 0, "Internal server error");
 
             return;
         }
 
-        // ...
+        // delete add code if any
+
+        if (!addCode.empty()) {
+
+            BSONObj query = BSON("addCode" << addCode);
+
+            DB::post([query] () {
+
+                DB::deleteRequest(query);
+            });
+        }
+
+        // send response
+
+        s->postRequestSuccess(
+                    requestId,
+                    UBJ_OBJ(
+                        "requestId"    << requestId <<
+                        "status"       << 1 <<
+                        "addCode"      << addCode <<
+                        "name"         << contact.obj["name"].str() <<
+                        "phone"        << contact.obj["phone"].str()));
+
+        // process requests for the requested user
+
+        s->m_server->io_service()->post(boost::bind(&Server::processUserRequests, s->m_server, contactAccountId));
     }
 }
 
 // ============================================================ //
 
-bool ClientSession::sendPacket()
+void ClientSession::AcceptContactTask::operator()()
 {
-    {
-        boost::mutex::scoped_lock locker(m_sending);
+    ClientSession *s = m_session.get();
 
-        if (m_sending) {
+    reenter (this) {
 
-            return false;
-        }
-    }
+        accountId = s->accountId();
 
-    // grab first packet from queue
+        // get contact request
 
-    Zway::PACKET pkt;
+        yield await(boost::bind(getRequest, BSON("id" << contactRequestId << "dst" << accountId)), request);
 
-    {
-        boost::mutex::scoped_lock locker(m_packetQueue);
+        if (!request.found) {
 
-        if (m_packetQueue->empty()) {
+            s->postRequestFailure(requestId, 1, "Invalid request");
 
-            Zway::Engine::processStreamSenders(true, [this] (Zway::PACKET pkt) -> bool {
+            return;
+        }
 
-                m_packetQueue->push(pkt);
+        // get account data
 
-                return true;
-            });
-        }
+        yield await(boost::bind(getAccount, BSON("id" << accountId), BSON("name" << 1 << "phone" << 1)), account);
 
-        if (!m_packetQueue->empty()) {
+        if (!account.found) {
 
-            pkt = m_packetQueue->front();
+            s->postRequestFailure(requestId, 0, "Internal server error");
 
-            m_packetQueue->pop();
+            return;
         }
-    }
 
-    if (!pkt)  {
+        requestSrc = request.obj["src"].numberInt();
 
-        return false;
-    }
+        if (!hasPublicKey) {
 
-    std::vector<boost::asio::const_buffer> buffers;
+            s->postRequestFailure(requestId, 0, "Invalid public key");
 
-    // add packet head
+            return;
+        }
 
-    buffers.push_back(boost::asio::buffer(&pkt->head(), sizeof(Zway::Packet::Head)));
+        // add request for accepted contact
 
-    // add packet body
+        yield await(
+                boost::bind(
+                    DB::addRequest,
+                    BSON(
+                        "id"               << requestId <<
+                        "contactRequestId" << contactRequestId <<
+                        "type"             << Zway::Request::AcceptContact <<
+                        "src"              << accountId <<
+                        "dst"              << requestSrc <<
+                        "name"             << account.obj["name"] <<
+                        "phone"            << account.obj["phone"] <<
+                        "publicKey"        << publicKey)),
+                added);
+
+        if (!added) {
+
+            s->postRequestFailure(requestId, 0, "Internal server error");
 
-    if (pkt->bodySize() > 0) {
+            return;
+        }
 
-        buffers.push_back(boost::asio::buffer(pkt->bodyData(), pkt->bodySize()));
-    }
 
-    // send packet
+        // send response
 
-    {
-        boost::mutex::scoped_lock locker(m_sending);
+        s->postRequestSuccess(
+                    requestId,
+                    UBJ_OBJ(
+                        "requestId"     << requestId <<
+                        "status"        << 1 <<
+                        "contactId"     << requestSrc <<
+                        "contactStatus" << s->getContactStatus(requestSrc) <<
+                        "name"          << request.obj["name"].str() <<
+                        "phone"         << request.obj["phone"].str() <<
+                        "publicKey"     << bsonObjToUbj(request.obj["publicKey"].Obj())));
 
-        m_sending = true;
-    }
 
-    boost::asio::async_write(
-            m_socket,
-            buffers,
-            boost::bind(
-                &ClientSession::onPacketSent,
-                shared_from_this(),
-                boost::asio::placeholders::error,
-                boost::asio::placeholders::bytes_transferred,
-                pkt));
+        // delete contact request
 
-    return true;
-}
+        yield await(boost::bind(DB::deleteRequest, BSON("id" << contactRequestId)), deleted);
 
-// ============================================================ //
+        // add contact
 
-bool ClientSession::recvPacket()
-{
-    Zway::PACKET pkt = Zway::Packet::create();
+        s->addContact(requestSrc);
 
-    if (!pkt) {
+        // process requests for the accepted contact
 
-        return false;
+        s->m_server->io_service()->post(boost::bind(&Server::processUserRequests, s->m_server, requestSrc));
     }
-
-    m_socket.async_read_some(
-                boost::asio::buffer(&pkt->head(), sizeof(Zway::Packet::Head)),
-                boost::bind(
-                    &ClientSession::onPacketHeadRecv,
-                    shared_from_this(),
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred,
-                    pkt));
-
-    return true;
 }
 
+#include <boost/asio/unyield.hpp>
+
 // ============================================================ //
 
-void ClientSession::recvPacketBody(Zway::PACKET pkt)
+bool ClientSession::processRequests()
 {
-    Zway::BUFFER body = Zway::Buffer::create(nullptr, pkt->bodySize());
+    uint32_t accountId = this->accountId();
 
-    if (!body) {
+    dbQuery<std::list<BSONObj>>(
+                [accountId] () {
 
-        // TODO invoke callback with error code
+                    return DB::getRequests(BSON("dst" << accountId));
+                },
+                [this] (const std::list<BSONObj> &requests) {
 
-        return;
-    }
+                    handleRequests(requests);
+                });
 
-    pkt->setBody(body);
-
-    m_socket.async_read_some(
-                boost::asio::buffer(body->data(), body->size()),
-                boost::bind(
-                    &ClientSession::onPacketBodyRecv,
-                    shared_from_this(),
-                    boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred,
-                    0,
-                    pkt));
+    return true;
 }
 
 // ============================================================ //
 
-bool ClientSession::processRequests()
+void ClientSession::handleRequests(const std::list<BSONObj> &requests)
 {
-    std::list<BSONObj> requests = DB::getRequests(BSON("dst" << accountId()));
+    // the engine keeps the requests, so their callbacks
+    // must not keep the session alive on their own
+
+    boost::weak_ptr<ClientSession> weak = shared_from_this();
 
     for (auto &request : requests) {
 
@@ -589,16 +1447,15 @@ bool ClientSession::processRequests()
 
             postRequest(DispatchRequest::create(
                             id, data,
-                            [this,id] (DispatchRequest::Pointer request, const Zway::UBJ::Object &response) {
+                            [weak,id] (DispatchRequest::Pointer request, const Zway::UBJ::Object &response) {
 
-                uint32_t status = response["status"].toInt();
+                CLIENT_SESSION self = weak.lock();
 
-                if (status == 1) {
+                uint32_t status = response["status"].toInt();
 
-                    if (!DB::deleteRequest(BSON("id" << id << "dst" << accountId()))) {
+                if (self && status == 1) {
 
-                        // ...
-                    }
+                    self->deleteStoredRequest(id);
                 }
 
             }));
@@ -616,7 +1473,7 @@ bool ClientSession::processRequests()
 
             postRequest(AddContactRequest::create(
                             id, data,
-                            [this,id] (AddContactRequest::Pointer request, const Zway::UBJ::Object &response) {
+                            [weak,id] (AddContactRequest::Pointer request, const Zway::UBJ::Object &response) {
 
             }));
 
@@ -636,26 +1493,19 @@ bool ClientSession::processRequests()
 
             // add contact
 
-            {
-                boost::mutex::scoped_lock lock(m_contacts);
-
-                uint32_t requestSrc = request["src"].numberInt();
-
-                (*m_contacts)[requestSrc] = UBJ_OBJ("contactId" << requestSrc << "notifyStatus" << 1);
-            }
+            addContact(request["src"].numberInt());
 
             postRequest(AcceptContactRequest::create(
                             id, data,
-                            [this,id] (AcceptContactRequest::Pointer request, const Zway::UBJ::Object &response) {
+                            [weak,id] (AcceptContactRequest::Pointer request, const Zway::UBJ::Object &response) {
 
-                uint32_t status = response["status"].toInt();
+                CLIENT_SESSION self = weak.lock();
 
-                if (status == 1) {
+                uint32_t status = response["status"].toInt();
 
-                    if (!DB::deleteRequest(BSON("id" << id << "dst" << accountId()))) {
+                if (self && status == 1) {
 
-                        // ...
-                    }
+                    self->deleteStoredRequest(id);
                 }
 
             }));
@@ -671,16 +1521,15 @@ bool ClientSession::processRequests()
 
             postRequest(RejectContactRequest::create(
                             id, data,
-                            [this,id] (RejectContactRequest::Pointer request, const Zway::UBJ::Object &response) {
+                            [weak,id] (RejectContactRequest::Pointer request, const Zway::UBJ::Object &response) {
 
-                uint32_t status = response["status"].toInt();
+                CLIENT_SESSION self = weak.lock();
 
-                if (status == 1) {
+                uint32_t status = response["status"].toInt();
 
-                    if (!DB::deleteRequest(BSON("id" << id << "dst" << accountId()))) {
+                if (self && status == 1) {
 
-                        // ...
-                    }
+                    self->deleteStoredRequest(id);
                 }
 
             }));
@@ -691,16 +1540,15 @@ bool ClientSession::processRequests()
 
             postRequest(PushRequest::create(
                             id, bsonToUbj(request["data"]),
-                            [this,id] (PushRequest::Pointer, const Zway::UBJ::Object &response) {
+                            [weak,id] (PushRequest::Pointer, const Zway::UBJ::Object &response) {
 
-                uint32_t status = response["status"].toInt();
+                CLIENT_SESSION self = weak.lock();
 
-                if (status == 1) {
+                uint32_t status = response["status"].toInt();
 
-                    if (!DB::deleteRequest(BSON("id" << id << "dst" << accountId()))) {
+                if (self && status == 1) {
 
-                        // ...
-                    }
+                    self->deleteStoredRequest(id);
 
                     for (auto &it : response["resources"].toArray()) {
 
@@ -708,13 +1556,13 @@ bool ClientSession::processRequests()
 
                         if (id) {
 
-                            STREAM_BUFFER_SENDER sender = StreamBufferSender::create(m_server, shared_from_this(), id);
+                            STREAM_BUFFER_SENDER sender = StreamBufferSender::create(self->m_server, self, id);
 
                             if (sender) {
 
-                                if (addStreamSender(sender)) {
+                                if (self->addStreamSender(sender)) {
 
-                                    m_server->addStreamBufferSender(sender);
+                                    self->m_server->addStreamBufferSender(sender);
                                 }
                                 else {
 
@@ -733,8 +1581,6 @@ bool ClientSession::processRequests()
         }
         }
     }
-
-    return true;
 }
 
 // ============================================================ //
@@ -757,14 +1603,22 @@ bool ClientSession::processDispatchRequest(const Zway::UBJ::Object &head)
                     "id"  << head["dispatchId"].toInt() <<
                     "$or" << BSON_ARRAY(BSON("src" << accountId()) << BSON("dst" << accountId())));
 
-        if (!DB::deleteRequest(query)) {
+        dbQuery<bool>(
+                    [query] () {
 
-            postRequestFailure(requestId, 0, "invalid data");
+                        return DB::deleteRequest(query);
+                    },
+                    [this, requestId] (const bool &res) {
 
-            return false;
-        }
+                        if (!res) {
+
+                            postRequestFailure(requestId, 0, "invalid data");
+
+                            return;
+                        }
 
-        postRequestSuccess(requestId);
+                        postRequestSuccess(requestId);
+                    });
 
         return true;
     }
@@ -803,19 +1657,6 @@ bool ClientSession::processCreateAccount(const Zway::UBJ::Object &head)
     }
 
 
-    BSONObj account;
-
-    if (DB::getAccount(BSON("name" << BSON("$regex" << head["name"].toStr() << "$options" << "i")), BSON("id" << 1), account)) {
-
-        postRequestFailure(requestId, 0, "Invalid account name");
-
-        return false;
-    }
-
-
-    uint32_t accountId = DB::newAccountId();
-
-
     SHA256_CTX ctx;
 
     if (!SHA256_Init(&ctx)) {
@@ -852,137 +1693,113 @@ bool ClientSession::processCreateAccount(const Zway::UBJ::Object &head)
     }
 
 
-    // create account
-
-    if (!DB::insertAccount(
-                accountId,
-                head["name"].toStr(),
-                head["phone"].toStr(),
-                head["findByName"].toBool(),
-                head["findByPhone"].toBool(),
-                BSONBinData(pass->data(), pass->size(), BinDataGeneral),
-                BSONBinData(salt->data(), salt->size(), BinDataGeneral))) {
+    // check name and create account on the db executor
 
-        postRequestFailure(requestId, 0, "Failed to create account");
+    struct Result
+    {
+        uint32_t accountId;
 
-        return false;
-    }
+        std::string error;
+    };
 
+    std::string name = head["name"].toStr();
 
-    // send response
+    std::string phone = head["phone"].toStr();
 
-    postRequestSuccess(requestId, UBJ_OBJ("accountId" << accountId));
+    bool findByName = head["findByName"].toBool();
 
-    return true;
-}
+    bool findByPhone = head["findByPhone"].toBool();
 
-// ============================================================ //
+    dbQuery<Result>(
+                [name, phone, findByName, findByPhone, pass, salt] () {
 
-bool ClientSession::processLogin(const Zway::UBJ::Object &head)
-{
-    uint32_t requestId = head["requestId"].toInt();
+                    Result res = {0, std::string()};
 
-    if (status() >= STATUS_LOGGEDIN) {
+                    BSONObj account;
 
-        postRequestFailure(requestId, 0, "Operation not permitted");
+                    if (DB::getAccount(BSON("name" << BSON("$regex" << name << "$options" << "i")), BSON("id" << 1), account)) {
 
-        return false;
-    }
+                        res.error = "Invalid account name";
 
-    // TODO input validation
+                        return res;
+                    }
 
-    if (!head.hasField("account")) {
+                    uint32_t accountId = DB::newAccountId();
 
-        postRequestFailure(requestId, 0, "account missing");
+                    if (!accountId || !DB::insertAccount(
+                                accountId,
+                                name,
+                                phone,
+                                findByName,
+                                findByPhone,
+                                BSONBinData(pass->data(), pass->size(), BinDataGeneral),
+                                BSONBinData(salt->data(), salt->size(), BinDataGeneral))) {
 
-    	return false;
-    }
+                        res.error = "Failed to create account";
 
-    if (!head.hasField("password")) {
+                        return res;
+                    }
 
-        postRequestFailure(requestId, 0, "password missing");
+                    res.accountId = accountId;
 
-        return false;
-    }
+                    return res;
+                },
+                [this, requestId] (const Result &res) {
 
+                    if (!res.error.empty()) {
 
-    uint32_t accountId = head["account"].toInt();
+                        postRequestFailure(requestId, 0, res.error);
 
+                        return;
+                    }
 
-    BSONObj account;
+                    // send response
 
-    if (!DB::getAccount(BSON("id" << accountId), BSON("pass" << 1 << "salt" << 1), account)) {
+                    postRequestSuccess(requestId, UBJ_OBJ("accountId" << res.accountId));
+                });
 
-        postRequestFailure(requestId, 0, "Invalid account id");
+    return true;
+}
 
-        return false;
-    }
+// ============================================================ //
 
+bool ClientSession::processLogin(const Zway::UBJ::Object &head)
+{
+    uint32_t requestId = head["requestId"].toInt();
 
-    if (!verifyPassword(account, head["password"].buffer())) {
+    if (status() >= STATUS_LOGGEDIN) {
 
-        postRequestFailure(requestId, 0, "login failed");
+        postRequestFailure(requestId, 0, "Operation not permitted");
 
         return false;
     }
 
+    // TODO input validation
 
-    setStatus(STATUS_LOGGEDIN);
-
-    // remove temporary session
-
-    m_server->removeSession(shared_from_this());
-
-    // append authenticated session
-
-    m_accountId = accountId;
-
-    m_server->appendSession(shared_from_this());
-
-
-    // set config
-
-    if (head.hasField("config")) {
+    if (!head.hasField("account")) {
 
-        if (!setConfig(head["config"])) {
+        postRequestFailure(requestId, 0, "account missing");
 
-        }
+    	return false;
     }
 
+    if (!head.hasField("password")) {
 
-    Zway::UBJ::Array status;
-
-    {
-        boost::mutex::scoped_lock locker(m_contacts);
-
-        for (auto &it : *m_contacts) {
-
-            uint32_t contactId = it.first;
-
-            uint32_t contactStatus = getContactStatus(contactId);
+        postRequestFailure(requestId, 0, "password missing");
 
-            status << UBJ_OBJ("contactId" << contactId << "status" << contactStatus);
-        }
+        return false;
     }
 
 
-    Zway::UBJ::Array inbox;
-
-    DB::getInbox(inbox, accountId);
-
-
-    // send response
+    LoginTask::Pointer task = LoginTask::create(shared_from_this());
 
-    postRequestSuccess(requestId, UBJ_OBJ("contactStatus" << status << "inbox" << inbox));
+    task->requestId = requestId;
 
+    task->accountId = head["account"].toInt();
 
-    // process requests
-
-    processRequests();
-
-
-    LOG_INFO << remoteHost() << " > login > accountId: " << accountId;
+    task->head = head;
 
+    task->start();
 
     return true;
 }
@@ -1002,14 +1819,18 @@ bool ClientSession::processLogout(const Zway::UBJ::Object &head)
 
     postRequestSuccess(requestId);
 
-    DB::setFcmToken(accountId(), std::string());
+    uint32_t accountId = this->accountId();
 
+    DB::post([accountId] () {
 
-    setStatus(STATUS_CONNECTED);
+        DB::setFcmToken(accountId, std::string());
+    });
 
 
+    setStatus(STATUS_CONNECTED);
+
 
-    broadcastStatus(0);
+    leavePresence();
 
 
     return true;
@@ -1056,20 +1877,7 @@ bool ClientSession::processContactStatusRequest(const Zway::UBJ::Object &head)
         return false;
     }
 
-    Zway::UBJ::Array status;
-
-    {
-        boost::mutex::scoped_lock locker(m_contacts);
-
-        for (auto &it : *m_contacts) {
-
-            uint32_t contactId = it.first;
-
-            uint32_t contactStatus = getContactStatus(contactId);
-
-            status << UBJ_OBJ("contactId" << contactId << "status" << contactStatus);
-        }
-    }
+    Zway::UBJ::Array status = getContactStatus();
 
     postRequestSuccess(requestId, UBJ_OBJ("contactStatus" << status));
 
@@ -1098,8 +1906,6 @@ bool ClientSession::processFindContactRequest(const Zway::UBJ::Object &head)
 
     Zway::UBJ::Object query = head["query"];
 
-    BSONArray contacts;
-
     if (query.hasField("subject")) {
 
         std::string subject = query["subject"].toStr();
@@ -1109,9 +1915,19 @@ bool ClientSession::processFindContactRequest(const Zway::UBJ::Object &head)
                     "id" << BSON("$ne" << accountId()) <<
                     "findByName" << true);
 
-        BSONObj fieldsToReturn = BSON("name" << 1);
+        dbQuery<BSONArray>(
+                    [q] () {
 
-        contacts = DB::getContacts(q, &fieldsToReturn);
+                        BSONObj fieldsToReturn = BSON("name" << 1);
+
+                        return DB::getContacts(q, &fieldsToReturn);
+                    },
+                    [this, requestId] (const BSONArray &contacts) {
+
+                        postRequestSuccess(requestId, UBJ_OBJ("result" << bsonArrToUbj(contacts)));
+                    });
+
+        return true;
     }
     /*
     else
@@ -1128,108 +1944,27 @@ bool ClientSession::processFindContactRequest(const Zway::UBJ::Object &head)
     }
     */
 
-    Zway::UBJ::Value result;
-
-    postRequestSuccess(requestId, UBJ_OBJ("result" << bsonArrToUbj(contacts)));
+    postRequestSuccess(requestId, UBJ_OBJ("result" << bsonArrToUbj(BSONArray())));
 
     return true;
 }
 
-// ============================================================ //
-
-bool ClientSession::processAddContactRequest(const Zway::UBJ::Object &head)
-{
-    uint32_t requestId = head["requestId"].toInt();
-
-    if (status() < STATUS_LOGGEDIN) {
-
-        postRequestFailure(requestId, 0, "Operation not permitted");
-
-        return false;
-    }
-
-    // input validation
-
-    // ...
-
-    // get our account data
-
-    BSONObj account;
-
-    if (!DB::getAccount(BSON("id" << accountId()), BSON("name" << 1 << "phone" << 1), account)) {
-
-        postRequestFailure(requestId, 0, "Internal server error");
-
-        return false;
-    }
-
-    BSONObj contactQuery;
-
-    // process add code if supplied
-
-    std::string addCode = head["addCode"].toStr();
-
-    if (!addCode.empty()) {
-        
-        // get request by add code in order to get contact id
-
-        BSONObj request;
-
-        if (!DB::getRequest(BSON("type" << Zway::Request::AddContact << "addCode" << addCode), request)) {
-
-            postRequestFailure(requestId, 0, "invalid add code");
-
-        	return false;
-        }
-
-        // query contact by account id
-
-        contactQuery = BSON("id" << request["src"]);
-    }
-    else {
-
-        std::string label = head["name"].toStr();
-
-        if (label.empty()) {
-
-            postRequestFailure(requestId, 0, "no label");
-
-            return false;
-        }
-
-        // query contact by label
-
-        contactQuery = BSON("name" << label << "findByName" << true);
-    }
-
-    BSONObj contact;
-
-    if (!DB::getAccount(contactQuery, BSON("id" << 1 << "name" << 1 << "phone" << 1), contact)) {
-
-        postRequestFailure(requestId, 0, "invalid label 1");
-
-        return false;
-    }
+// ============================================================ //
 
-	uint32_t contactAccountId = contact["id"].numberInt();
+bool ClientSession::processAddContactRequest(const Zway::UBJ::Object &head)
+{
+    uint32_t requestId = head["requestId"].toInt();
 
-    if (contactAccountId == accountId()) {
+    if (status() < STATUS_LOGGEDIN) {
 
-        postRequestFailure(requestId, 0, "invalid label 2");
+        postRequestFailure(requestId, 0, "Operation not permitted");
 
         return false;
     }
 
-    if (DB::requestPending(
-            BSON(
-                "type" << Zway::Request::AddContact <<
-                "src"  << accountId() <<
-                "dst"  << contactAccountId))) {
-
-        postRequestFailure(requestId, 0, "invalid data");
+    // input validation
 
-		return false;
-	}
+    // ...
 
     mongo::BSONObj publicKey;
 
@@ -1247,52 +1982,19 @@ bool ClientSession::processAddContactRequest(const Zway::UBJ::Object &head)
         }
     }
 
-    if (!hasPublicKey) {
-
-        postRequestFailure(requestId, 0, "Invalid public key");
-
-        return false;
-    }
-
-    if (!DB::addRequest(
-            BSON(
-                "id"        << requestId <<
-                "type"      << Zway::Request::AddContact <<
-                "time"      << 0 <<
-                "ttl"       << 0 <<
-                "src"       << accountId() <<
-                "dst"       << contactAccountId <<
-                "name"      << account["name"] <<
-                "phone"     << account["phone"] <<
-                "publicKey" << publicKey <<
-                "addCode"   << addCode))) {
-
-        postRequestFailure(requestId, 0, "Internal server error");
-
-		return false;
-	}
+    AddContactTask::Pointer task = AddContactTask::create(shared_from_this());
 
-    // delete add code if any 
+    task->requestId = requestId;
 
-    if (!addCode.empty()) {
+    task->addCode = head["addCode"].toStr();
 
-        DB::deleteRequest(BSON("addCode" << addCode));
-    }
-
-    // send response
+    task->label = head["name"].toStr();
 
-    postRequestSuccess(
-                requestId,
-                UBJ_OBJ(
-                    "requestId"    << requestId <<
-                    "status"       << 1 <<
-                    "addCode"      << addCode <<
-                    "name"         << contact["name"].str() <<
-                    "phone"        << contact["phone"].str()));
+    task->hasPublicKey = hasPublicKey;
 
-    // process requests for the requested user
+    task->publicKey = publicKey;
 
-    m_server->io_service()->post(boost::bind(&Server::processUserRequests, m_server, contactAccountId));
+    task->start();
 
     return true;
 }
@@ -1333,17 +2035,6 @@ bool ClientSession::processCreateAddCode(const Zway::UBJ::Object &head)
         return false;
     }
 
-    // get our account data
-
-    BSONObj account;
-
-    if (!DB::getAccount(BSON("id" << accountId()), BSON("name" << 1 << "phone" << 1), account)) {
-
-        postRequestFailure(requestId, 0, "Internal server error");
-
-        return false;
-    }
-
     // create add code
 
     std::string addCode;
@@ -1354,31 +2045,50 @@ bool ClientSession::processCreateAddCode(const Zway::UBJ::Object &head)
 
     std::string addCodeHex = boost::algorithm::hex(addCode);
 
-    if (!DB::addRequest(
-            BSON(
-                "id"        << requestId <<
-                "type"      << Zway::Request::AddContact <<
-                "time"      << 0 <<
-                "ttl"       << 0 <<
-                "src"       << accountId() <<
-                "name"      << account["name"] <<
-                "phone"     << account["phone"] <<
-                "publicKey" << publicKey <<
-                "addCode"   << addCodeHex))) {
+    uint32_t accountId = this->accountId();
 
-        postRequestFailure(requestId, 0, "Internal server error");
+    dbQuery<bool>(
+                [requestId, accountId, publicKey, addCodeHex] () {
 
-        return false;
-    }
+                    // get our account data
 
-    // send response
+                    BSONObj account;
 
-    postRequestSuccess(
-                requestId,
-                UBJ_OBJ(
-                    "requestId"    << requestId <<
-                    "status"       << 1 <<
-                    "addCode"      << addCodeHex));
+                    if (!DB::getAccount(BSON("id" << accountId), BSON("name" << 1 << "phone" << 1), account)) {
+
+                        return false;
+                    }
+
+                    return DB::addRequest(
+                            BSON(
+                                "id"        << requestId <<
+                                "type"      << Zway::Request::AddContact <<
+                                "time"      << 0 <<
+                                "ttl"       << 0 <<
+                                "src"       << accountId <<
+                                "name"      << account["name"] <<
+                                "phone"     << account["phone"] <<
+                                "publicKey" << publicKey <<
+                                "addCode"   << addCodeHex));
+                },
+                [this, requestId, addCodeHex] (const bool &res) {
+
+                    if (!res) {
+
+                        postRequestFailure(requestId, 0, "Internal server error");
+
+                        return;
+                    }
+
+                    // send response
+
+                    postRequestSuccess(
+                                requestId,
+                                UBJ_OBJ(
+                                    "requestId"    << requestId <<
+                                    "status"       << 1 <<
+                                    "addCode"      << addCodeHex));
+                });
 
     return true;
 }
@@ -1396,34 +2106,8 @@ bool ClientSession::processAcceptContact(const Zway::UBJ::Object &head)
         return false;
     }
 
-    // get contact request
-
     uint32_t contactRequestId = head["contactRequestId"].toInt();
 
-    BSONObj request;
-
-    if (!DB::getRequest(BSON("id" << contactRequestId << "dst" << accountId()), request)) {
-
-        postRequestFailure(requestId, 1, "Invalid request");
-
-    	return false;
-    }
-
-    // get account data
-
-    BSONObj account;
-
-    if (!DB::getAccount(BSON("id" << accountId()), BSON("name" << 1 << "phone" << 1), account)) {
-
-        postRequestFailure(requestId, 0, "Internal server error");
-
-        return false;
-    }
-
-    uint32_t requestSrc = request["src"].numberInt();
-
-    Zway::UBJ::Object contactPublicKey = bsonObjToUbj(request["publicKey"].Obj());
-
     BSONObj publicKey;
 
     bool hasPublicKey = head.hasField("publicKey");
@@ -1440,74 +2124,17 @@ bool ClientSession::processAcceptContact(const Zway::UBJ::Object &head)
         }
     }
 
-    if (!hasPublicKey) {
-
-        postRequestFailure(requestId, 0, "Invalid public key");
-
-        return false;
-    }
-
-    /*
-    if (DB::requestPending(
-            BSON(
-                "type" << Zway::Request::AcceptContactType <<
-                "src"  << accountId() <<
-                "dst"  << requestSrc))) {
-
-        postRequestFailure(requestId, 0, "Invalid request");
-
-        return false;
-    }
-    */
-
-    // add request for accepted contact
-
-    if (!DB::addRequest(
-			BSON(
-                "id"               << requestId <<
-                "contactRequestId" << contactRequestId <<
-                "type"             << Zway::Request::AcceptContact <<
-                "src"              << accountId() <<
-                "dst"              << requestSrc <<
-                "name"             << account["name"] <<
-                "phone"            << account["phone"] <<
-                "publicKey"        << publicKey))) {
-
-        postRequestFailure(requestId, 0, "Internal server error");
-
-		return false;
-	}
+    AcceptContactTask::Pointer task = AcceptContactTask::create(shared_from_this());
 
+    task->requestId = requestId;
 
-    // send response
-
-    postRequestSuccess(
-                requestId,
-                UBJ_OBJ(
-                    "requestId"     << requestId <<
-                    "status"        << 1 <<
-                    "contactId"     << requestSrc <<
-                    "contactStatus" << getContactStatus(requestSrc) <<
-                    "name"          << request["name"].str() <<
-                    "phone"         << request["phone"].str() <<
-                    "publicKey"     << contactPublicKey));
-
-
-    // delete contact request
-
-    DB::deleteRequest(BSON("id" << contactRequestId));
-
-    // add contact
-
-    {
-        boost::mutex::scoped_lock lock(m_contacts);
+    task->contactRequestId = contactRequestId;
 
-        (*m_contacts)[requestSrc] = UBJ_OBJ("contactId" << requestSrc << "notifyStatus" << 1);
-    }
+    task->hasPublicKey = hasPublicKey;
 
-    // process requests for the accepted contact
+    task->publicKey = publicKey;
 
-    m_server->io_service()->post(boost::bind(&Server::processUserRequests, m_server, requestSrc));
+    task->start();
 
 	return true;
 }
@@ -1527,63 +2154,92 @@ bool ClientSession::processRejectContact(const Zway::UBJ::Object &head)
 
     // TODO input validation
 
-    // get contact request
-
     uint32_t contactRequestId = head["contactRequestId"].toInt();
 
-    BSONObj request;
+    uint32_t accountId = this->accountId();
 
-    if (!DB::getRequest(BSON("id" << contactRequestId << "dst" << accountId()), request)) {
+    struct Result
+    {
+        uint32_t errorCode;
 
-        postRequestFailure(requestId, 1, "Invalid request");
+        std::string error;
 
-    	return false;
-    }
+        uint32_t requestSrc;
+    };
 
-    uint32_t requestSrc = request["src"].numberInt();
+    dbQuery<Result>(
+                [requestId, contactRequestId, accountId] () {
 
-    /*
-    if (DB::requestPending(
-            BSON(
-                "type" << Zway::Request::RejectContactType <<
-                "src"  << accountId() <<
-                "dst"  << requestSrc))) {
+                    Result res = {0, std::string(), 0};
 
-        postRequestFailure(requestId, 2, "Invalid request");
+                    // get contact request
 
-        return false;
-    }
-    */
+                    BSONObj request;
 
-    // add request for rejected contact
+                    if (!DB::getRequest(BSON("id" << contactRequestId << "dst" << accountId), request)) {
 
-    if (!DB::addRequest(
-            BSON(
-                "type"             << Zway::Request::RejectContact <<
-                "id"               << requestId <<
-                "contactRequestId" << contactRequestId <<
-                "src"              << accountId() <<
-                "dst"              << requestSrc))) {
+                        res.errorCode = 1;
 
-        postRequestFailure(requestId, 0, "Internal server error");
+                        res.error = "Invalid request";
 
-        return false;
-	}
+                        return res;
+                    }
 
+                    res.requestSrc = request["src"].numberInt();
 
-    // send response
+                    /*
+                    if (DB::requestPending(
+                            BSON(
+                                "type" << Zway::Request::RejectContactType <<
+                                "src"  << accountId <<
+                                "dst"  << res.requestSrc))) {
 
-    postRequestSuccess(requestId);
+                        res.errorCode = 2;
+
+                        res.error = "Invalid request";
+
+                        return res;
+                    }
+                    */
+
+                    // add request for rejected contact
 
+                    if (!DB::addRequest(
+                            BSON(
+                                "type"             << Zway::Request::RejectContact <<
+                                "id"               << requestId <<
+                                "contactRequestId" << contactRequestId <<
+                                "src"              << accountId <<
+                                "dst"              << res.requestSrc))) {
 
-    // delete contact request
+                        res.error = "Internal server error";
 
-    DB::deleteRequest(BSON("id" << contactRequestId));
+                        return res;
+                    }
+
+                    // delete contact request
+
+                    DB::deleteRequest(BSON("id" << contactRequestId));
+
+                    return res;
+                },
+                [this, requestId] (const Result &res) {
+
+                    if (!res.error.empty()) {
+
+                        postRequestFailure(requestId, res.errorCode, res.error);
+
+                        return;
+                    }
 
+                    // send response
 
-    // process requests for the rejected contact
+                    postRequestSuccess(requestId);
 
-    m_server->io_service()->post(boost::bind(&Server::processUserRequests, m_server, requestSrc));
+                    // process requests for the rejected contact
+
+                    m_server->io_service()->post(boost::bind(&Server::processUserRequests, m_server, res.requestSrc));
+                });
 
 	return true;
 }
@@ -1639,6 +2295,10 @@ bool ClientSession::processPushRequest(const Zway::UBJ::Object &head)
 
     Zway::UBJ::Array keys = head["keys"];
 
+    std::vector<BSONObj> requests;
+
+    std::vector<uint32_t> recipients;
+
     for (auto &it : keys) {
 
         uint32_t dst = it["dst"].toInt();
@@ -1652,7 +2312,7 @@ bool ClientSession::processPushRequest(const Zway::UBJ::Object &head)
 
         forward["key"] = it["key"];
 
-        if (!DB::addRequest(
+        requests.push_back(
                 BSON(
                     "id"        << requestId <<
                     "type"      << Zway::Request::Push <<
@@ -1660,92 +2320,184 @@ bool ClientSession::processPushRequest(const Zway::UBJ::Object &head)
                     "ttl"       << 0 <<
                     "src"       << accountId() <<
                     "dst"       << dst <<
-                    "data"      << ubjToBson(forward)))) {
+                    "data"      << ubjToBson(forward)));
 
-            postRequestFailure(requestId, 0, "Internal server error");
+        recipients.push_back(dst);
+    }
 
-            // ...
+    // store all requests with one bulk insert on the db executor,
+    // recipients whose request got stored are notified in any case
 
-            continue;
-        }
+    dbQuery<std::vector<uint32_t>>(
+                [requests, recipients] () {
 
-        m_server->io_service()->post(boost::bind(&Server::processUserRequests, m_server, dst));
-    }
+                    std::vector<size_t> stored;
 
-    // send response
+                    DB::addRequests(requests, stored);
 
-    postRequestSuccess(requestId, response);
+                    std::vector<uint32_t> res;
+
+                    for (size_t i : stored) {
+
+                        res.push_back(recipients[i]);
+                    }
+
+                    return res;
+                },
+                [this, requestId, response, recipients] (const std::vector<uint32_t> &stored) {
+
+                    if (!stored.empty()) {
+
+                        m_server->io_service()->post(boost::bind(&Server::processUsersRequests, m_server, stored));
+                    }
+
+                    if (stored.size() < recipients.size()) {
+
+                        postRequestFailure(requestId, 0, "Internal server error");
+
+                        return;
+                    }
+
+                    // send response
+
+                    postRequestSuccess(requestId, response);
+                });
 
     return true;
 }
 
 // ============================================================ //
 
-void ClientSession::broadcastStatus(uint32_t status, bool check)
+void ClientSession::broadcastStatus(uint32_t status)
 {
-    if (check && !m_config["notifyStatus"].toBool()) {
-
-        return;
-    }
+    // notify the watching sessions of online contacts,
+    // the payload is built once and shared by all of them
 
-    // notify online contacts about status change
+    Zway::UBJ::Array contactStatus = {
+        UBJ_OBJ("contactId" << accountId() << "status" << status)
+    };
 
-    boost::mutex::scoped_lock locker(m_contacts);
+    boost::shared_ptr<const Zway::UBJ::Object> obj = boost::make_shared<const Zway::UBJ::Object>(
+                UBJ_OBJ(
+                    "requestType"   << Zway::Request::ContactStatus <<
+                    "contactStatus" << contactStatus));
 
-    /*
-    BSONObjBuilder builder;
+    uint32_t requestId;
 
-    builder.append(boost::lexical_cast<std::string>(m_accountId), BSON("status" << status));
+    RAND_pseudo_bytes((uint8_t*)&requestId, sizeof(requestId));
 
-    BSONObj contactStatus = builder.obj();
-    */
+    m_server->presence().visitWatchers(accountId(), [requestId, obj] (const CLIENT_SESSION &session) {
 
-    for (auto &it : *m_contacts) {
+        // the contact's session is owned by its own strand
 
-        uint32_t contactId = it.first;
+        CLIENT_SESSION s = session;
 
-        if (it.second["notifyStatus"].toBool()) {
+        session->execute([s, requestId, obj] () {
 
-            CLIENT_SESSION_LIST sessions = m_server->getSessions(contactId);
+            s->addUbjSender(requestId, Zway::Packet::Request, *obj);
+        });
+    });
+}
 
-            if (!sessions.empty()) {
+// ============================================================ //
 
-                Zway::UBJ::Array contactStatus = {
-                    UBJ_OBJ("contactId" << accountId() << "status" << status)
-                };
+uint32_t ClientSession::getContactStatus(uint32_t contactId)
+{
+    return m_server->presence().status(contactId);
+}
 
-                Zway::UBJ::Object obj = UBJ_OBJ(
-                            "requestType"   << Zway::Request::ContactStatus <<
-                            "contactStatus" << contactStatus);
+// ============================================================ //
 
-                uint32_t requestId;
+Zway::UBJ::Array ClientSession::getContactStatus()
+{
+    std::vector<uint32_t> contacts;
 
-                RAND_pseudo_bytes((uint8_t*)&requestId, sizeof(requestId));
+    {
+        ThreadSafeMutex::scoped_lock locker(m_contacts);
 
-                for (auto &session : sessions) {
+        for (auto &it : *m_contacts) {
 
-                    session->addUbjSender(requestId, Zway::Packet::Request, obj);
-                }
-            }
+            contacts.push_back(it.first);
         }
     }
+
+    std::vector<uint32_t> status = m_server->presence().status(contacts);
+
+    Zway::UBJ::Array res;
+
+    for (size_t i=0; i<contacts.size(); ++i) {
+
+        res << UBJ_OBJ("contactId" << contacts[i] << "status" << status[i]);
+    }
+
+    return res;
 }
 
 // ============================================================ //
 
-uint32_t ClientSession::getContactStatus(uint32_t contactId)
+void ClientSession::addContact(uint32_t contactId)
+{
+    {
+        ThreadSafeMutex::scoped_lock lock(m_contacts);
+
+        (*m_contacts)[contactId] = UBJ_OBJ("contactId" << contactId << "notifyStatus" << 1);
+    }
+
+    if (m_presenceAttached) {
+
+        Presence &presence = m_server->presence();
+
+        presence.addAudience(accountId(), contactId);
+
+        presence.subscribe(shared_from_this(), {contactId});
+
+        m_watching.insert(contactId);
+    }
+}
+
+// ============================================================ //
+
+void ClientSession::leavePresence()
 {
-    CLIENT_SESSION_LIST sessions = m_server->getSessions(contactId);
+    if (!m_presenceAttached) {
+
+        return;
+    }
 
-    for (CLIENT_SESSION &s: sessions) {
+    m_presenceAttached = false;
 
-        if (s->config()["notifyStatus"].toBool()) {
+    Presence &presence = m_server->presence();
 
-            return 1;
+    presence.unsubscribe(shared_from_this(), m_watching);
+
+    m_watching.clear();
+
+    if (m_presenceVisible) {
+
+        m_presenceVisible = false;
+
+        if (presence.setVisible(accountId(), false)) {
+
+            broadcastStatus(0);
         }
     }
 
-    return 0;
+    presence.detach(accountId());
+}
+
+// ============================================================ //
+
+void ClientSession::deleteStoredRequest(uint32_t requestId)
+{
+    uint32_t accountId = this->accountId();
+
+    DB::post([requestId, accountId] () {
+
+        if (!DB::deleteRequest(BSON("id" << requestId << "dst" << accountId))) {
+
+            // ...
+        }
+    });
 }
 
 // ============================================================ //
@@ -1757,12 +2509,17 @@ bool ClientSession::postPacket(Zway::PACKET pkt)
         return false;
     }
 
-    {
-        boost::mutex::scoped_lock locker(m_packetQueue);
+    // bulk packets are refused above the hard limit,
+    // control packets are still queued
 
-        m_packetQueue->push(pkt);
+    if (pkt->streamType() == Zway::Packet::Resource &&
+            m_queuedBytes >= m_server->options().sendQueueHardLimit) {
+
+        return false;
     }
 
+    enqueuePacket(pkt);
+
     sendPacket();
 
     return true;
@@ -1784,66 +2541,94 @@ bool ClientSession::addStreamSender(Zway::STREAM_SENDER sender)
 
 // ============================================================ //
 
-bool ClientSession::processIncomingRequest(const Zway::UBJ::Object &request)
+void ClientSession::registerRequestHandlers()
 {
-    switch (request["requestType"].toInt()) {
+    // the names are used as labels in the status output
 
-        case Zway::Request::Dispatch:
+    RequestDispatcher::add(Zway::Request::Dispatch, "dispatch", &ClientSession::processDispatchRequest);
 
-            return processDispatchRequest(request);
+    RequestDispatcher::add(Zway::Request::CreateAccount, "create_account", &ClientSession::processCreateAccount);
 
-        case Zway::Request::CreateAccount:
+    RequestDispatcher::add(Zway::Request::Login, "login", &ClientSession::processLogin);
 
-            return processCreateAccount(request);
+    RequestDispatcher::add(Zway::Request::Logout, "logout", &ClientSession::processLogout);
 
-        case Zway::Request::Login:
+    RequestDispatcher::add(Zway::Request::Config, "config", &ClientSession::processConfigRequest);
 
-            return processLogin(request);
+    RequestDispatcher::add(Zway::Request::AddContact, "add_contact", &ClientSession::processAddContactRequest);
 
-        case Zway::Request::Logout:
+    RequestDispatcher::add(Zway::Request::CreateAddCode, "create_add_code", &ClientSession::processCreateAddCode);
 
-            return processLogout(request);
+    RequestDispatcher::add(Zway::Request::FindContact, "find_contact", &ClientSession::processFindContactRequest);
 
-        case Zway::Request::Config:
+    RequestDispatcher::add(Zway::Request::AcceptContact, "accept_contact", &ClientSession::processAcceptContact);
 
-            return processConfigRequest(request);
+    RequestDispatcher::add(Zway::Request::RejectContact, "reject_contact", &ClientSession::processRejectContact);
 
-        case Zway::Request::AddContact:
+    RequestDispatcher::add(Zway::Request::ContactStatus, "contact_status", &ClientSession::processContactStatusRequest);
 
-            return processAddContactRequest(request);
+    RequestDispatcher::add(Zway::Request::Push, "push", &ClientSession::processPushRequest);
+}
+
+// ============================================================ //
 
-        case Zway::Request::CreateAddCode:
+bool ClientSession::processIncomingRequest(const Zway::UBJ::Object &request)
+{
+    uint32_t type = request["requestType"].toInt();
 
-            return processCreateAddCode(request);
+    if (!RequestDispatcher::has(type)) {
 
-        case Zway::Request::FindContact:
+        return false;
+    }
 
-            return processFindContactRequest(request);
+    // the request is timed until its response is posted
 
-        case Zway::Request::AcceptContact:
+    uint32_t requestId = request["requestId"].toInt();
 
-            return processAcceptContact(request);
+    m_pendingRequests[requestId] = PendingRequest{type, nowMicros()};
 
-        case Zway::Request::RejectContact:
+    bool res = RequestDispatcher::dispatch(this, type, request);
 
-            return processRejectContact(request);
+    if (!res) {
 
-        case Zway::Request::ContactStatus:
+        finishRequest(requestId, false);
+    }
 
-            return processContactStatusRequest(request);
+    return res;
+}
 
-        case Zway::Request::Push:
+// ============================================================ //
 
-            return processPushRequest(request);
+void ClientSession::finishRequest(uint32_t requestId, bool success)
+{
+    auto it = m_pendingRequests.find(requestId);
 
-        /*
-        case Request::Pull:
+    if (it == m_pendingRequests.end()) {
 
-            return processGetResource(request);
-            */
+        return;
     }
 
-    return false;
+    RequestDispatcher::record(it->second.type, nowMicros() - it->second.time, success);
+
+    m_pendingRequests.erase(it);
+}
+
+// ============================================================ //
+
+bool ClientSession::postRequestSuccess(uint32_t requestId, const Zway::UBJ::Object &response)
+{
+    finishRequest(requestId, true);
+
+    return Zway::Engine::postRequestSuccess(requestId, response);
+}
+
+// ============================================================ //
+
+bool ClientSession::postRequestFailure(uint32_t requestId, uint32_t errorCode, const std::string &errorMessage)
+{
+    finishRequest(requestId, false);
+
+    return Zway::Engine::postRequestFailure(requestId, errorCode, errorMessage);
 }
 
 // ============================================================ //
@@ -1888,7 +2673,7 @@ Zway::STREAM_RECEIVER ClientSession::createStreamReceiver(const Zway::Packet &pk
 
                         // dispatch request
 
-                        if (!DB::addRequest(
+                        BSONObj request =
                                 BSON(
                                     "id"          << receiver->id() <<
                                     "type"         << Zway::Request::Dispatch <<
@@ -1896,12 +2681,22 @@ Zway::STREAM_RECEIVER ClientSession::createStreamReceiver(const Zway::Packet &pk
                                     "ttl"          << 0 <<
                                     "src"          << 0 <<
                                     "dst"          << accountId() <<
-                                    "dispatchType" << 6))) {
+                                    "dispatchType" << 6);
 
-                            // ...
-                        }
+                        dbQuery<bool>(
+                                    [request] () {
 
-                        processRequests();
+                                        return DB::addRequest(request);
+                                    },
+                                    [this] (const bool &res) {
+
+                                        if (!res) {
+
+                                            // ...
+                                        }
+
+                                        processRequests();
+                                    });
 
                     });
 
@@ -1983,15 +2778,43 @@ bool ClientSession::verifyPassword(const mongo::BSONObj &account, Zway::BUFFER p
 
 uint32_t ClientSession::status()
 {
-    boost::mutex::scoped_lock locker(m_status);
+    return m_status.load();
+}
+
+// ============================================================ //
+
+uint32_t ClientSession::numPacketsSent()
+{
+    return m_numPacketsSent;
+}
+
+// ============================================================ //
+
+uint32_t ClientSession::numWritesSent()
+{
+    return m_numWritesSent;
+}
+
+// ============================================================ //
 
-    return m_status;
+uint32_t ClientSession::queuedPackets()
+{
+    return m_queuedPackets;
+}
+
+// ============================================================ //
+
+uint64_t ClientSession::queuedBytes()
+{
+    return m_queuedBytes;
 }
 
 // ============================================================ //
 
 std::string ClientSession::remoteHost()
 {
+    ThreadSafeMutex::scoped_lock lock(m_remoteHost);
+
     return m_remoteHost;
 }
 
@@ -2004,6 +2827,15 @@ uint32_t ClientSession::accountId()
 
 // ============================================================ //
 
+std::string ClientSession::accountName()
+{
+    ThreadSafeMutex::scoped_lock lock(m_accountName);
+
+    return m_accountName;
+}
+
+// ============================================================ //
+
 ssl_socket::lowest_layer_type& ClientSession::socket()
 {
     return m_socket.lowest_layer();
@@ -2011,6 +2843,23 @@ ssl_socket::lowest_layer_type& ClientSession::socket()
 
 // ============================================================ //
 
+IO_SERVICE_SHARD ClientSession::shard()
+{
+    return m_shard;
+}
+
+// ============================================================ //
+
+void ClientSession::execute(const boost::function<void ()> &handler)
+{
+    // always post, never dispatch, so callers holding
+    // locks never reenter this session synchronously
+
+    m_strand.post(handler);
+}
+
+// ============================================================ //
+
 void ClientSession::ubjValToBson(const std::string &key, const Zway::UBJ::Value &val, mongo::BSONObjBuilder &ob)
 {
     switch (val.type()) {
@@ -0,0 +1,119 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "sessionregistry.h"
+
+// ============================================================ //
+// SessionRegistry
+// ============================================================ //
+
+SessionRegistry::SessionRegistry()
+{
+
+}
+
+// ============================================================ //
+
+void SessionRegistry::append(const CLIENT_SESSION &session)
+{
+    append(session->accountId(), session);
+}
+
+// ============================================================ //
+
+void SessionRegistry::append(uint32_t accountId, const CLIENT_SESSION &session)
+{
+    Shard &s = m_shards.shard(accountId);
+
+    boost::unique_lock<boost::shared_mutex> locker(s.mutex);
+
+    s.map[accountId].push_back(session);
+}
+
+// ============================================================ //
+
+void SessionRegistry::remove(const CLIENT_SESSION &session)
+{
+    uint32_t accountId = session->accountId();
+
+    Shard &s = m_shards.shard(accountId);
+
+    boost::unique_lock<boost::shared_mutex> locker(s.mutex);
+
+    auto it = s.map.find(accountId);
+
+    if (it != s.map.end()) {
+
+        it->second.remove(session);
+
+        if (it->second.empty()) {
+
+            s.map.erase(it);
+        }
+    }
+}
+
+// ============================================================ //
+
+CLIENT_SESSION_LIST SessionRegistry::removeAll()
+{
+    CLIENT_SESSION_LIST res;
+
+    for (Shard &s : m_shards) {
+
+        boost::unique_lock<boost::shared_mutex> locker(s.mutex);
+
+        for (auto &it : s.map) {
+
+            res.splice(res.end(), it.second);
+        }
+
+        s.map.clear();
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+size_t SessionRegistry::size()
+{
+    size_t res = 0;
+
+    for (Shard &s : m_shards) {
+
+        boost::shared_lock<boost::shared_mutex> locker(s.mutex);
+
+        res += s.map.size();
+    }
+
+    return res;
+}
+
+// ============================================================ //
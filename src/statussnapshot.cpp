@@ -0,0 +1,138 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "statussnapshot.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <sstream>
+
+// ============================================================ //
+// StatusSnapshot
+// ============================================================ //
+
+STATUS_SNAPSHOT StatusSnapshot::create()
+{
+    return STATUS_SNAPSHOT(new StatusSnapshot());
+}
+
+// ============================================================ //
+
+StatusSnapshot::StatusSnapshot()
+{
+
+}
+
+// ============================================================ //
+
+std::string StatusSnapshot::format(uint32_t offset, uint32_t limit) const
+{
+    std::stringstream ss;
+
+    ss << summary;
+
+    uint32_t begin = std::min<size_t>(offset, sessions.size());
+
+    uint32_t end = std::min<size_t>((uint64_t)begin + limit, sessions.size());
+
+    ss << "Sessions: " << sessions.size();
+
+    if (begin > 0 || end < sessions.size()) {
+
+        ss << " (showing " << begin << " to " << end << ")";
+    }
+
+    ss << "\n";
+
+    for (uint32_t i=begin; i<end; ++i) {
+
+        const Session &s = sessions[i];
+
+        ss << s.remoteHost << "\t" << (s.accountName.empty() ? "?" : s.accountName);
+
+        // average number of packets per write
+
+        ss << "\tbatch: " << (s.numWritesSent ? (double)s.numPacketsSent / s.numWritesSent : 0.0);
+
+        ss << "\tqueue: " << s.queuedPackets << " packets, " << s.queuedBytes << " bytes\n";
+    }
+
+    return ss.str();
+}
+
+// ============================================================ //
+
+std::string StatusSnapshot::format(const std::string &query) const
+{
+    uint32_t offset = 0;
+
+    uint32_t limit = STATUS_PAGE_SIZE;
+
+    std::vector<std::string> params;
+
+    boost::split(params, query, boost::is_any_of("&"));
+
+    for (const std::string &param : params) {
+
+        size_t pos = param.find('=');
+
+        if (pos == std::string::npos) {
+
+            continue;
+        }
+
+        std::string key = param.substr(0, pos);
+
+        uint32_t value = 0;
+
+        try {
+
+            value = boost::lexical_cast<uint32_t>(param.substr(pos + 1));
+        }
+        catch (boost::bad_lexical_cast &) {
+
+            continue;
+        }
+
+        if (key == "offset") {
+
+            offset = value;
+        }
+        else
+        if (key == "limit") {
+
+            limit = value;
+        }
+    }
+
+    return format(offset, limit);
+}
+
+// ============================================================ //
@@ -57,7 +57,7 @@ FileBuffer::Pointer FileBuffer::open(const std::string &filename)
 }
 
 FileBuffer::FileBuffer()
-    : m_fh(nullptr)
+    : m_fh(nullptr, LockName("FileBuffer::m_fh"))
 {
 
 }
@@ -108,7 +108,7 @@ bool FileBuffer::load(const std::string &filename)
 
 void FileBuffer::release()
 {
-    boost::mutex::scoped_lock locker(m_fh);
+    ThreadSafeMutex::scoped_lock locker(m_fh);
 
     if (m_fh) {
 
@@ -120,7 +120,7 @@ void FileBuffer::release()
 
 bool FileBuffer::read(uint8_t *data, size_t size, size_t offset, size_t *bytesRead)
 {
-    boost::mutex::scoped_lock locker(m_fh);
+    ThreadSafeMutex::scoped_lock locker(m_fh);
 
     if (fseek(m_fh, offset, SEEK_SET)) {
 
@@ -144,7 +144,7 @@ bool FileBuffer::read(uint8_t *data, size_t size, size_t offset, size_t *bytesRe
 
 bool FileBuffer::write(const uint8_t *data, size_t size, size_t offset, size_t *bytesWritten)
 {
-    boost::mutex::scoped_lock locker(m_fh);
+    ThreadSafeMutex::scoped_lock locker(m_fh);
 
     if (fseek(m_fh, offset, SEEK_SET)) {
 
@@ -170,7 +170,7 @@ bool FileBuffer::write(const uint8_t *data, size_t size, size_t offset, size_t *
 
 void FileBuffer::flush()
 {
-     boost::mutex::scoped_lock locker(m_fh);
+     ThreadSafeMutex::scoped_lock locker(m_fh);
 
      if (m_fh) {
 
@@ -310,11 +310,7 @@ bool StreamBuffer::read(uint8_t *data, size_t size, size_t offset, size_t *bytes
         *bytesRead = 0;
     }
 
-    {
-        boost::mutex::scoped_lock lock(m_lastActivity);
-
-        m_lastActivity = time(nullptr);
-    }
+    m_lastActivity.store(time(nullptr), std::memory_order_relaxed);
 
     return true;
 }
@@ -335,21 +331,20 @@ bool StreamBuffer::write(const uint8_t *data, size_t size, size_t offset, size_t
         return false;
     }
 
-    {
-        boost::mutex::scoped_lock lock(m_bytesReadable);
-
-        m_bytesReadable += bw;
-    }
+    m_bytesReadable.fetchAdd(bw, std::memory_order_release);
 
     if (bytesWritten) {
 
         *bytesWritten = bw;
     }
 
-    {
-        boost::mutex::scoped_lock lock(m_lastActivity);
+    m_lastActivity.store(time(nullptr), std::memory_order_relaxed);
+
+    // wake up the senders waiting for these bytes
+
+    if (m_writeHandler && bw) {
 
-        m_lastActivity = time(nullptr);
+        m_writeHandler(m_streamId);
     }
 
     return true;
@@ -380,16 +375,12 @@ uint32_t StreamBuffer::streamParts()
 
 uint32_t StreamBuffer::bytesReadable()
 {
-    boost::mutex::scoped_lock lock(m_bytesReadable);
-
-    return m_bytesReadable;
+    return m_bytesReadable.load();
 }
 
 uint64_t StreamBuffer::lastActivity()
 {
-    boost::mutex::scoped_lock lock(m_lastActivity);
-
-    return m_lastActivity;
+    return m_lastActivity.load(std::memory_order_relaxed);
 }
 
 size_t StreamBuffer::size()
@@ -402,4 +393,9 @@ size_t StreamBuffer::size()
     return 0;
 }
 
+void StreamBuffer::setWriteHandler(const WriteHandler &handler)
+{
+    m_writeHandler = handler;
+}
+
 // ============================================================ //
@@ -71,7 +71,19 @@ bool StreamBufferSender::preparePacket(Zway::PACKET &pkt, size_t bytesToSend, si
 
     if (m_buffer) {
 
-        return Zway::BufferSender::preparePacket(pkt, bytesToSend, bytesSent);
+        if (!Zway::BufferSender::preparePacket(pkt, bytesToSend, bytesSent)) {
+
+            return false;
+        }
+
+        // the last chunk is on its way, no more wakeups needed
+
+        if (pkt && bytesSent + pkt->bodySize() >= m_size) {
+
+            m_server->removeStreamBufferSender(this);
+        }
+
+        return true;
     }
     else {
 
@@ -0,0 +1,275 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "timerwheel.h"
+
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+
+// ============================================================ //
+// TimerWheel::Entry
+// ============================================================ //
+
+TimerWheel::Entry::Entry()
+    : m_lastActivity(0),
+      m_cancelled(false)
+{
+
+}
+
+TimerWheel::Entry::~Entry()
+{
+
+}
+
+uint64_t TimerWheel::Entry::lastActivity()
+{
+    return m_lastActivity.load(std::memory_order_relaxed);
+}
+
+void TimerWheel::Entry::cancel()
+{
+    m_cancelled.store(true, std::memory_order_relaxed);
+}
+
+bool TimerWheel::Entry::cancelled()
+{
+    return m_cancelled.load(std::memory_order_relaxed);
+}
+
+void TimerWheel::Entry::onDeadline()
+{
+
+}
+
+// ============================================================ //
+// TimerWheel
+// ============================================================ //
+
+TIMER_WHEEL TimerWheel::create(boost::asio::io_service &io_service, uint32_t timeout, uint32_t tick)
+{
+    return TIMER_WHEEL(new TimerWheel(io_service, timeout, tick ? tick : TIMER_WHEEL_TICK));
+}
+
+TimerWheel::TimerWheel(boost::asio::io_service &io_service, uint32_t timeout, uint32_t tick)
+    : m_timeout(timeout),
+      m_tick(tick),
+      m_now(0),
+      m_cursor(0),
+      m_timer(io_service),
+      m_slots(timeout / tick + 2)
+{
+    m_now = clock();
+
+    m_cursor = m_now / m_tick;
+}
+
+// ============================================================ //
+
+void TimerWheel::start()
+{
+    schedule();
+}
+
+// ============================================================ //
+
+void TimerWheel::stop()
+{
+    boost::system::error_code ec;
+
+    m_timer.cancel(ec);
+}
+
+// ============================================================ //
+
+void TimerWheel::add(const boost::shared_ptr<Entry> &entry)
+{
+    touch(*entry);
+
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    uint64_t deadline = (entry->lastActivity() + m_timeout) / m_tick;
+
+    m_slots[deadline % m_slots.size()].push_back(entry);
+}
+
+// ============================================================ //
+
+void TimerWheel::touch(Entry &entry)
+{
+    entry.m_lastActivity.store(m_now.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+// ============================================================ //
+
+void TimerWheel::setDeadline(const boost::shared_ptr<Entry> &entry, uint64_t deadline)
+{
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    m_deadlines[entry.get()] = std::make_pair(boost::weak_ptr<Entry>(entry), deadline);
+}
+
+// ============================================================ //
+
+void TimerWheel::clearDeadline(Entry &entry)
+{
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    m_deadlines.erase(&entry);
+}
+
+// ============================================================ //
+
+uint64_t TimerWheel::now()
+{
+    return m_now.load(std::memory_order_relaxed);
+}
+
+// ============================================================ //
+
+void TimerWheel::schedule()
+{
+    m_timer.expires_from_now(boost::posix_time::milliseconds(m_tick));
+
+    m_timer.async_wait(
+                boost::bind(
+                    &TimerWheel::onTick,
+                    shared_from_this(),
+                    boost::asio::placeholders::error));
+}
+
+// ============================================================ //
+
+void TimerWheel::onTick(const boost::system::error_code &error)
+{
+    if (error) {
+
+        return;
+    }
+
+    uint64_t now = clock();
+
+    m_now.store(now, std::memory_order_relaxed);
+
+    std::list<boost::shared_ptr<Entry>> expired;
+
+    std::list<boost::shared_ptr<Entry>> overdue;
+
+    {
+        boost::mutex::scoped_lock locker(m_mutex);
+
+        // catch up with every slot passed since the last tick
+
+        for (; m_cursor <= now / m_tick; ++m_cursor) {
+
+            std::list<boost::weak_ptr<Entry>> &slot = m_slots[m_cursor % m_slots.size()];
+
+            for (auto it = slot.begin(); it != slot.end();) {
+
+                boost::shared_ptr<Entry> entry = it->lock();
+
+                if (!entry || entry->cancelled()) {
+
+                    it = slot.erase(it);
+
+                    continue;
+                }
+
+                uint64_t deadline = (entry->lastActivity() + m_timeout) / m_tick;
+
+                if (deadline <= m_cursor) {
+
+                    expired.push_back(entry);
+
+                    it = slot.erase(it);
+                }
+                else {
+
+                    std::list<boost::weak_ptr<Entry>> &next = m_slots[deadline % m_slots.size()];
+
+                    if (&next != &slot) {
+
+                        auto cur = it++;
+
+                        next.splice(next.end(), slot, cur);
+                    }
+                    else {
+
+                        ++it;
+                    }
+                }
+            }
+        }
+
+        for (auto it = m_deadlines.begin(); it != m_deadlines.end();) {
+
+            boost::shared_ptr<Entry> entry = it->second.first.lock();
+
+            if (!entry || entry->cancelled()) {
+
+                it = m_deadlines.erase(it);
+
+                continue;
+            }
+
+            if (it->second.second <= now) {
+
+                overdue.push_back(entry);
+
+                it = m_deadlines.erase(it);
+
+                continue;
+            }
+
+            ++it;
+        }
+    }
+
+    for (auto &entry : expired) {
+
+        entry->onTimeout();
+    }
+
+    for (auto &entry : overdue) {
+
+        entry->onDeadline();
+    }
+
+    schedule();
+}
+
+// ============================================================ //
+
+uint64_t TimerWheel::clock()
+{
+    return boost::chrono::duration_cast<boost::chrono::milliseconds>(
+                boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================ //
@@ -0,0 +1,233 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2018 Marc Weiler
+//
+//   This program is free software: you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, either version 3 of the License, or
+//   (at your option) any later version.
+//
+//   This program is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//   GNU General Public License for more details.
+//
+//   You should have received a copy of the GNU General Public License
+//   along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// ============================================================ //
+
+#include "tlssessioncache.h"
+#include "logger.h"
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include <cstring>
+
+// ============================================================ //
+
+uint32_t TlsSessionCache::m_ticketLifetime = TLS_TICKET_LIFETIME;
+
+boost::mutex TlsSessionCache::m_mutex;
+
+std::deque<TlsSessionCache::TicketKey> TlsSessionCache::m_keys;
+
+std::atomic<uint64_t> TlsSessionCache::m_numResumed(0);
+
+std::atomic<uint64_t> TlsSessionCache::m_numFull(0);
+
+// ============================================================ //
+// TlsSessionCache
+// ============================================================ //
+
+bool TlsSessionCache::startup(SSL_CTX *ctx, uint32_t cacheSize, uint32_t ticketLifetime)
+{
+    static const unsigned char sessionIdContext[] = "zway-server";
+
+    m_ticketLifetime = ticketLifetime ? ticketLifetime : TLS_TICKET_LIFETIME;
+
+    {
+        boost::mutex::scoped_lock locker(m_mutex);
+
+        if (!rotate(time(nullptr))) {
+
+            return false;
+        }
+    }
+
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+
+    SSL_CTX_sess_set_cache_size(ctx, cacheSize);
+
+    SSL_CTX_set_timeout(ctx, m_ticketLifetime);
+
+    if (!SSL_CTX_set_session_id_context(ctx, sessionIdContext, sizeof(sessionIdContext) - 1)) {
+
+        return false;
+    }
+
+    if (!SSL_CTX_set_tlsext_ticket_key_cb(ctx, &TlsSessionCache::ticketKeyCallback)) {
+
+        return false;
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+void TlsSessionCache::handshakeCompleted(SSL *ssl)
+{
+    if (SSL_session_reused(ssl)) {
+
+        m_numResumed.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+
+        m_numFull.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// ============================================================ //
+
+uint64_t TlsSessionCache::numResumedHandshakes()
+{
+    return m_numResumed.load(std::memory_order_relaxed);
+}
+
+// ============================================================ //
+
+uint64_t TlsSessionCache::numFullHandshakes()
+{
+    return m_numFull.load(std::memory_order_relaxed);
+}
+
+// ============================================================ //
+
+bool TlsSessionCache::rotate(time_t now)
+{
+    // m_mutex must be held
+
+    TicketKey key;
+
+    if (RAND_bytes(key.name, sizeof(key.name)) != 1 ||
+        RAND_bytes(key.aesKey, sizeof(key.aesKey)) != 1 ||
+        RAND_bytes(key.hmacKey, sizeof(key.hmacKey)) != 1) {
+
+        LOG_ERROR << "Failed to create session ticket key";
+
+        return false;
+    }
+
+    key.created = now;
+
+    m_keys.push_front(key);
+
+    // keep the previous key for decryption only
+
+    while (m_keys.size() > 2) {
+
+        m_keys.pop_back();
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+int TlsSessionCache::ticketKeyCallback(
+        SSL *,
+        unsigned char *keyName,
+        unsigned char *iv,
+        EVP_CIPHER_CTX *ctx,
+        HMAC_CTX *hctx,
+        int enc)
+{
+    boost::mutex::scoped_lock locker(m_mutex);
+
+    time_t now = time(nullptr);
+
+    if (m_keys.empty() || now - m_keys.front().created >= (time_t)m_ticketLifetime) {
+
+        if (!rotate(now) && m_keys.empty()) {
+
+            return -1;
+        }
+    }
+
+    if (enc) {
+
+        // issue a new ticket with the current key
+
+        const TicketKey &key = m_keys.front();
+
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+
+            return -1;
+        }
+
+        memcpy(keyName, key.name, sizeof(key.name));
+
+        if (!EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key.aesKey, iv)) {
+
+            return -1;
+        }
+
+        if (!HMAC_Init_ex(hctx, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(), nullptr)) {
+
+            return -1;
+        }
+
+        return 1;
+    }
+
+    for (size_t i=0; i<m_keys.size(); ++i) {
+
+        const TicketKey &key = m_keys[i];
+
+        if (memcmp(keyName, key.name, sizeof(key.name))) {
+
+            continue;
+        }
+
+        // a key is accepted for two lifetimes in total
+
+        if (now - key.created >= 2 * (time_t)m_ticketLifetime) {
+
+            return 0;
+        }
+
+        if (!HMAC_Init_ex(hctx, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(), nullptr)) {
+
+            return -1;
+        }
+
+        if (!EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key.aesKey, iv)) {
+
+            return -1;
+        }
+
+        // ask for a new ticket if this one was
+        // issued with the previous key
+
+        return i == 0 ? 1 : 2;
+    }
+
+    // unknown key, fall back to a full handshake
+
+    return 0;
+}
+
+// ============================================================ //